@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Lock-free ring buffer for exactly one producer task and one consumer task.
+ *
+ * push() and pop() never block. The indices run freely and are only written by
+ * their owner (head by the producer, tail by the consumer), the release store of
+ * an index publishes the item it covers.
+ */
+template <typename T, size_t Size>
+class SpscRing {
+    static_assert(Size && (Size & (Size - 1)) == 0, "the size must be a power of 2");
+
+public:
+    /**
+     * @brief Append an item (producer).
+     * @return false if the ring is full
+     */
+    bool push(const T &item)
+    {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head - tail.load(std::memory_order_acquire) == Size)
+        {
+            return false;
+        }
+        items[head & (Size - 1)] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item (consumer).
+     * @return false if the ring is empty
+     */
+    bool pop(T &item)
+    {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        item = items[tail & (Size - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Size];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Per channel lookup tables which fuse the gamma correction, the global
+ * brightness and the white balance. The encoders translate each byte with a
+ * single lookup.
+ *
+ * The tables are indexed by the stored channel (0 = R, 1 = G, 2 = B, 3 = W).
+ * Setting a parameter only marks the tables as outdated, they are rebuilt by
+ * update(), which is called by WS2812::present() before the frame is encoded.
+ */
+class ColorLut {
+public:
+    ColorLut();
+
+    void setBrightness(uint8_t brightness);
+    uint8_t getBrightness() const { return brightness; }
+    void setGammaCorrection(bool enabled);
+    bool getGammaCorrection() const { return gamma; }
+    void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b, uint8_t w = 255);
+
+    bool update();
+
+    const uint8_t *channel(uint8_t stored) const { return tables[stored]; }
+
+private:
+    uint8_t tables[4][256];
+    uint8_t brightness;
+    bool gamma;
+    uint8_t balance[4];
+    bool outdated;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ws2812.hpp"
+
+/**
+ * @brief WS2812 strip with a pixel order which is known at compile time.
+ *
+ * The offsets and the number of LEDs per pixel are constants (see PixelLayout),
+ * so the encoder compiles to straight-line stores. It is passed to the base class,
+ * so it is also used through a WS2812 pointer or reference. fill() and
+ * setPixelColor() are the ones of WS2812, the pixels are stored in the same
+ * R, G, B (, W) order for every pixel order.
+ * Strips with white LEDs (e.g. PixelOrder::GRBW) are supported.
+ */
+template <PixelOrder::PixelOrder Order>
+class FixedOrderWS2812 : public WS2812 {
+public:
+    typedef PixelLayout<Order> Layout;
+
+    FixedOrderWS2812(gpio_num_t pin, uint16_t numPixels)
+        : FixedOrderWS2812(std::make_unique<BitBangOutput>(pin), numPixels) {}
+
+    FixedOrderWS2812(std::unique_ptr<Ws2812Output> output, uint16_t numPixels)
+        : WS2812(std::move(output), numPixels, Order, encode) {}
+
+private:
+    /**
+     * @brief Each byte is stored at its final position in the big endian words
+     * of the wire buffer (index ^ 3 on the little endian CPU).
+     */
+    static void encode(const WS2812 &strip, uint32_t *out)
+    {
+        static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the encoder requires a little endian CPU");
+
+        const auto &self = static_cast<const FixedOrderWS2812 &>(strip);
+        const uint8_t *pixel = self.pixels.data();
+        const ColorLut &lut = self.lut;
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(out);
+        const uint32_t end = self.numPixels * Layout::channels;
+
+        for (uint32_t index = 0; index < end; index += Layout::channels, pixel += Layout::channels)
+        {
+            for (uint8_t led = 0; led < Layout::channels; led++)
+            {
+                bytes[(index + led) ^ 3] = lut.channel(Layout::wireToStored[led])[pixel[Layout::wireToStored[led]]];
+            }
+        }
+    }
+};
@@ -16,8 +16,8 @@
  * B R W G
  * 2 1 3 0
  * 
- * If the R value is equal to the W value, the strip has no white led.
- * As this is not the case in our example, the strip has a white led.
+ * If one of the offsets is 3, the strip has a white led (4 LEDs per pixel).
+ * As this is the case in our example, the strip has a white led.
  * 
  * For the implementation we need an array which holds the values for
  * pixel. As each pixel consists of 4 LEDs and each LED requires one byte
@@ -69,4 +69,34 @@ namespace PixelOrder {
         BGWR = 02310, ///< Blue,  Green, White, Red   (2031)
         BGRW = 03210, ///< Blue,  Green, Red,   White (3021)
     };
-}
\ No newline at end of file
+
+    /**
+     * @brief True if the order has a white LED, i.e. one of the offsets is 3.
+     */
+    constexpr bool hasWhite(PixelOrder order)
+    {
+        return (order >> 9 & 0b111) == 3 || (order >> 6 & 0b111) == 3 || (order >> 3 & 0b111) == 3 || (order & 0b111) == 3;
+    }
+}
+
+/**
+ * @brief Decodes a PixelOrder at compile time.
+ * The pixels are stored in R, G, B (, W) order, wireToStored maps the
+ * position of a byte on the wire to the stored channel.
+ */
+template <PixelOrder::PixelOrder Order>
+struct PixelLayout {
+    static constexpr uint8_t offW = Order >> 9 & 0b111;
+    static constexpr uint8_t offR = Order >> 6 & 0b111;
+    static constexpr uint8_t offG = Order >> 3 & 0b111;
+    static constexpr uint8_t offB = Order & 0b111;
+    static constexpr bool hasWhite = PixelOrder::hasWhite(Order);
+    static constexpr uint8_t channels = hasWhite ? 4 : 3;
+
+    static constexpr uint8_t storedAt(uint8_t wirePosition)
+    {
+        return wirePosition == offR ? 0 : wirePosition == offG ? 1 : wirePosition == offB ? 2 : 3;
+    }
+
+    static constexpr uint8_t wireToStored[4] = {storedAt(0), storedAt(1), storedAt(2), storedAt(3)};
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * @brief A buffer with a capacity fixed at compile time, stored inside its owner.
+ * It provides the part of the std::vector interface which the frame buffers use.
+ * A size above the capacity is cut to the capacity, the owner checks the size.
+ */
+template <typename T, size_t Capacity>
+class StaticBuffer {
+    static_assert(Capacity > 0, "the capacity must not be 0");
+
+public:
+    StaticBuffer() : length(0), items{} {}
+    explicit StaticBuffer(size_t size) : length(size < Capacity ? size : Capacity), items{} {}
+
+    T *data() { return items; }
+    const T *data() const { return items; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+
+    T *begin() { return items; }
+    T *end() { return items + length; }
+    const T *begin() const { return items; }
+    const T *end() const { return items + length; }
+    const T *cbegin() const { return items; }
+    const T *cend() const { return items + length; }
+
+    /**
+     * @brief Change the size, new items are zeroed like by std::vector.
+     */
+    void resize(size_t size)
+    {
+        size = size < Capacity ? size : Capacity;
+        for (size_t i = length; i < size; i++)
+        {
+            items[i] = T();
+        }
+        length = size;
+    }
+
+private:
+    size_t length;
+    T items[Capacity];
+};
+
+/**
+ * @brief Buffer whose size depends on the strip. With CONFIG_ESP_WS2812_STATIC_ALLOCATION
+ * it is a StaticBuffer of the given capacity, so it lives in the object which owns it and
+ * the RAM is known at link time. Otherwise it is a std::vector allocated for the actual size.
+ */
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+template <typename T, size_t Capacity>
+using StripBuffer = StaticBuffer<T, Capacity>;
+#else
+template <typename T, size_t Capacity>
+using StripBuffer = std::vector<T>;
+#endif
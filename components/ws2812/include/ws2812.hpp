@@ -6,7 +6,11 @@
 #include "FreeRTOS.h"
 #include "freertos/task.h"
 #include <vector>
+#include <memory>
 #include "rtosTimestamp.hpp"
+#include "ws2812Output.hpp"
+#include "ColorLut.hpp"
+#include "stripBuffer.hpp"
 
 #define F_CPU (CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ * 1000000)
 #define CYCLES_800_T0H  (F_CPU / 2500001) // 0.4us
@@ -32,6 +36,53 @@ struct RgbColor {
     }
 };
 
+struct WrgbColor {
+    uint8_t w;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+
+    WrgbColor() : w(0), r(0), g(0), b(0) {}
+    WrgbColor(uint8_t w, uint8_t r, uint8_t g, uint8_t b) : w(w), r(r), g(g), b(b) {}
+
+    bool operator==(const WrgbColor &rhs) const {
+        return w == rhs.w && r == rhs.r && g == rhs.g && b == rhs.b;
+    }
+
+    bool operator!=(const WrgbColor &rhs) const {
+        return !(rhs == *this);
+    }
+};
+
+
+/**
+ * @brief Cycle counts of the last show() call.
+ * encodeCycles is measured by present(), transmitCycles is the time
+ * transmitPending() was blocked by the output. For the BitBangOutput this
+ * is the time with disabled interrupts, unless it is interruptible (see CriticalStats).
+ * maxTransmitCycles and totalTransmitCycles cover all frames since the strip was created.
+ */
+struct ShowStats {
+    uint32_t encodeCycles;
+    uint32_t transmitCycles;
+    uint32_t wireCycles;        // nominal time of the transmitted bits (bits * CYCLES_800)
+    uint32_t maxTransmitCycles;
+    uint64_t totalTransmitCycles;
+};
+
+/**
+ * @brief Counters of the dirty tracking since the strip was created.
+ * present() skips a frame if no pixel was written since the last present() or if
+ * the frame is identical to the one on the strip. Otherwise only the prefix up to
+ * the last changed pixel is transmitted, bytesSaved counts the bytes which were
+ * not sent because of this.
+ */
+struct FrameCounters {
+    uint32_t framesPresented;
+    uint32_t framesSkipped;
+    uint32_t framesTransmitted;
+    uint64_t bytesSaved;
+};
 
 /**
  * @brief This class provides basic functions to control a WS2812 LED strip.
@@ -44,34 +95,88 @@ struct RgbColor {
  * The library is inspired by the Adafruit NeoPixel library for Arduino, but
  * modified to work in a FreeRTOS environment. Also 
  * 
+ * The pixels are the back buffer, which is rendered by the application.
+ * present() encodes them into the back wire buffer. At the latch point
+ * (output ready) transmitPending() swaps the front and the back wire buffer
+ * and sends the front buffer. So a task can render and present frame N+1
+ * while another task transmits frame N. show() does both in one call.
+ *
+ * The strip latches whatever prefix of a frame it receives, the remaining
+ * pixels keep their colors. So only the bytes up to the last pixel which
+ * differs from the frame on the strip are transmitted.
  */
 class WS2812 {
     
 public:
-    WS2812(gpio_num_t pin, uint16_t numPixels, PixelOrder::PixelOrder pixelOrder);  
-    ~WS2812();  
+    // capacity of the buffers in the static allocation mode, RGBW pixels of the configured strip
+    static constexpr size_t MAX_PIXEL_BYTES = CONFIG_ESP_WS2812_NUM_LED * 4;
+    static constexpr size_t MAX_WIRE_WORDS = (MAX_PIXEL_BYTES + 3) / 4;
+
+    WS2812(gpio_num_t pin, uint16_t numPixels, PixelOrder::PixelOrder pixelOrder);
+    WS2812(std::unique_ptr<Ws2812Output> output, uint16_t numPixels, PixelOrder::PixelOrder pixelOrder);
+    virtual ~WS2812();
     bool show();
+    void present();
+    bool transmitPending();
+    bool waitForFrame(TickType_t ticksToWait);
     void clear();
     void fill(const RgbColor&);
+    void fill(const WrgbColor&);
     void setPixelColor(uint16_t n, const RgbColor& color);
+    void setPixelColor(uint16_t n, const WrgbColor& color);
+    uint8_t *getPixelBuffer();
+    size_t getPixelBufferSize() const { return pixels.size(); }
     void setBrightness(uint8_t);
+    uint8_t getBrightness() const { return lut.getBrightness(); }
+    void setGammaCorrection(bool enabled);
+    void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b, uint8_t w = 255);
     bool isReady() const;
     bool stripHasWhite() const;    
-    uint8_t getPixelCount() const { return numPixels; }
+    uint16_t getPixelCount() const { return numPixels; }
+    const ShowStats& getShowStats() const { return showStats; }
+    const FrameCounters& getFrameCounters() const { return frameCounters; }
+    const CriticalStats& getCriticalStats() const { return output->getCriticalStats(); }
+    void setDoneCallback(Ws2812Output::DoneCallback callback, void *arg) { output->setDoneCallback(callback, arg); }
     
 
-private:
-    const gpio_num_t pin;
+protected:
+    typedef void (*Encoder)(const WS2812 &strip, uint32_t *out);
+
+    WS2812(std::unique_ptr<Ws2812Output> output, uint16_t numPixels, PixelOrder::PixelOrder pixelOrder, Encoder encoder);
+
     uint16_t numPixels;
+    const uint8_t numLedsPerPixel;
+    ColorLut lut;                   // gamma, brightness and white balance, applied by the encoder
+    StripBuffer<uint8_t, MAX_PIXEL_BYTES> pixels;   // colors in R, G, B (, W) order, independent of the pixel order
+    uint16_t dirtyEnd;              // highest pixel written since the last present() + 1, 0 if clean
+
+    void markDirty(uint16_t n)
+    {
+        if (n >= dirtyEnd)
+        {
+            dirtyEnd = n + 1;
+        }
+    }
+
+private:
+    typedef StripBuffer<uint32_t, MAX_WIRE_WORDS> WireBuffer;
+
+    std::unique_ptr<Ws2812Output> output;
     const uint8_t offW;
     const uint8_t offR;
     const uint8_t offG;
     const uint8_t offB;
-    const uint8_t numLedsPerPixel;
-    uint8_t brightness;
-    std::vector<uint8_t> pixels;
-    RtosTimestamp lastShow;
+    const Encoder encoder;
+    WireBuffer wire[2];             // encoded bitstreams, MSB of the first word is sent first
+    uint32_t wireBits;
+    uint32_t pendingBits;           // length of the changed prefix of the back wire buffer
+    uint8_t front;                  // index of the wire buffer which is transmitted
+    bool pending;                   // the back wire buffer holds a frame which was not transmitted
+    bool frontShown;                // the strip shows the front wire buffer (a full frame was sent)
+    QueueHandle_t frameQueue;       // signals presented frames to the transmitting task
+    ShowStats showStats;
+    FrameCounters frameCounters;
 
-    void enablePin(gpio_num_t pin) const;
-    void disablePin(gpio_num_t pin) const;
+    uint32_t changedBits(uint8_t back) const;
+    static void encodeRuntime(const WS2812 &strip, uint32_t *out);
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Encoders which convert the WS2812 bitstream (see WS2812::encode())
+ * into the bitstream of a peripheral. All functions are pure, they only
+ * read the input and write the output buffer.
+ *
+ * Both encoders use a peripheral bit time of 0.3125us (3.2 MHz). Each WS2812
+ * bit is represented by 4 peripheral bits:
+ * - 0: 1000 (high 0.3125us, low 0.9375us)
+ * - 1: 1110 (high 0.9375us, low 0.3125us)
+ *
+ * The number of WS2812 bits must be a multiple of 8.
+ */
+namespace ws2812encoder {
+
+/** Peripheral bit clock in Hz */
+constexpr uint32_t BIT_CLOCK = 3200000;
+
+/** Zero words appended to an I2S frame, which keep the line low for the reset time (> 50us) */
+constexpr size_t I2S_RESET_WORDS = 6;
+
+/** Number of 32 bit I2S words for the given number of WS2812 bits */
+constexpr size_t i2sWords(uint32_t bits) { return bits / 8; }
+
+/** Number of UART characters for the given number of WS2812 bits */
+constexpr size_t uartBytes(uint32_t bits) { return bits / 2; }
+
+/**
+ * @brief Encode for the I2S peripheral. Each WS2812 byte results in one 32 bit word,
+ * the MSB is transmitted first.
+ *
+ * @param wire WS2812 bitstream, the MSB of the first word is the first bit
+ * @param bits number of bits in the bitstream
+ * @param out buffer with at least i2sWords(bits) words
+ * @return number of words written
+ */
+size_t encodeI2s(const uint32_t *wire, uint32_t bits, uint32_t *out);
+
+/**
+ * @brief Encode for the UART peripheral running at 3.2 Mbaud, 6N1 with an inverted TX line.
+ * With the start and the stop bit each character has 8 bit times, so one character
+ * represents 2 WS2812 bits.
+ *
+ * @param wire WS2812 bitstream, the MSB of the first word is the first bit
+ * @param bits number of bits in the bitstream
+ * @param out buffer with at least uartBytes(bits) bytes
+ * @return number of bytes written
+ */
+size_t encodeUart(const uint32_t *wire, uint32_t bits, uint8_t *out);
+
+/** Maximum number of strips which are transposed into one stream */
+constexpr uint8_t MAX_LANES = 8;
+
+/**
+ * @brief Transpose the bitstreams of up to MAX_LANES strips for a parallel transmission.
+ * Bit n of out[i] is bit i of lane n, so each output byte holds the bits which are
+ * sent at the same time. Lanes shorter than bits are padded with zeros.
+ * The streams are transposed in blocks of 8 x 8 bits.
+ *
+ * @param lanes WS2812 bitstreams, nullptr for an unused lane
+ * @param laneBits number of bits of each lane, a multiple of 8
+ * @param laneCount number of lanes (up to MAX_LANES)
+ * @param bits number of output bytes, a multiple of 8
+ * @param out buffer with at least bits bytes
+ */
+void transposeLanes(const uint32_t *const *lanes, const uint32_t *laneBits, uint8_t laneCount, uint32_t bits, uint8_t *out);
+
+} // namespace ws2812encoder
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Hardware abstraction for the time critical parts of the driver.
+ *
+ * On the ESP8266 the functions map directly to the ccount register, the
+ * GPIO set/clear registers and the FreeRTOS critical section. They are
+ * forced inline, so the timing of the transmission loop is the same as
+ * with the raw register accesses.
+ *
+ * If WS2812_HOST_SIM is defined (host build, see host/), the functions are
+ * provided by the simulation which implements a virtual clock and GPIO.
+ */
+namespace ws2812hal {
+
+#ifdef WS2812_HOST_SIM
+
+uint32_t cycleCount();
+void pinSet(uint32_t pinMask);
+void pinClear(uint32_t pinMask);
+void enterCritical();
+void exitCritical();
+
+#else
+
+static inline __attribute__((always_inline)) uint32_t cycleCount()
+{
+    return xthal_get_ccount();
+}
+
+static inline __attribute__((always_inline)) void pinSet(uint32_t pinMask)
+{
+    GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, pinMask);
+}
+
+static inline __attribute__((always_inline)) void pinClear(uint32_t pinMask)
+{
+    GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, pinMask);
+}
+
+static inline __attribute__((always_inline)) void enterCritical()
+{
+    taskENTER_CRITICAL();
+}
+
+static inline __attribute__((always_inline)) void exitCritical()
+{
+    taskEXIT_CRITICAL();
+}
+
+#endif
+
+} // namespace ws2812hal
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "rtosTimestamp.hpp"
+
+/**
+ * @brief Windows with disabled interrupts of the transmissions since the output was created.
+ * Only outputs which send the bits from the CPU (BitBangOutput) disable the interrupts
+ * for the transmission, the counters of the other outputs stay 0.
+ */
+struct CriticalStats {
+    uint32_t frameMaxCycles;    // longest window of the last frame
+    uint32_t maxCycles;         // longest window of all frames
+    uint32_t gapOverflows;      // an interrupt delayed a bit beyond the maximum gap, the frame was sent again
+    uint32_t fallbacks;         // frames sent in one window after the retries overflowed as well
+};
+
+/**
+ * @brief Interface of the transport which sends the encoded bitstream to the strip.
+ *
+ * transmit() must not keep a reference to the bitstream after it returned, so the
+ * caller can encode the next frame while the current one is transmitted in the
+ * background. isReady() returns true if the last frame and the reset time (latch)
+ * are completed. The done callback is called when the frame was sent, depending
+ * on the output this happens from an interrupt or another task.
+ */
+class Ws2812Output {
+public:
+    typedef void (*DoneCallback)(void *arg);
+
+    virtual ~Ws2812Output() = default;
+    virtual bool transmit(const uint32_t *wire, uint32_t bits) = 0;
+    virtual bool isReady() const = 0;
+
+    void setDoneCallback(DoneCallback callback, void *arg)
+    {
+        doneCallback = callback;
+        doneArg = arg;
+    }
+
+    const CriticalStats &getCriticalStats() const { return criticalStats; }
+
+protected:
+    CriticalStats criticalStats = {};
+
+
+    void notifyDone() const
+    {
+        if (doneCallback)
+        {
+            doneCallback(doneArg);
+        }
+    }
+
+private:
+    DoneCallback doneCallback = nullptr;
+    void *doneArg = nullptr;
+};
+
+/**
+ * @brief Cycle counted transmission on any GPIO. Blocks the CPU with
+ * disabled interrupts for the whole frame.
+ *
+ * In the interruptible mode (setInterruptible()) the interrupts are enabled
+ * between the pixels. An interrupt delays the next bit, the strip latches if
+ * the line stays low for too long. If the delay exceeded the maximum gap, the
+ * frame is sent again from the first pixel after the reset time. After
+ * MAX_RETRIES overflows the frame is sent with disabled interrupts.
+ */
+class BitBangOutput : public Ws2812Output {
+public:
+    static constexpr uint8_t MAX_RETRIES = 2;
+
+    BitBangOutput(gpio_num_t pin);
+    ~BitBangOutput() override;
+    bool transmit(const uint32_t *wire, uint32_t bits) override;
+    bool isReady() const override;
+    void setInterruptible(uint8_t pixelBits, uint32_t maxGapUs);
+
+private:
+    const gpio_num_t pin;
+    RtosTimestamp lastShow;
+    uint8_t windowBits;         // bits sent with disabled interrupts, 0 for the whole frame
+    uint32_t maxGapCycles;      // longest delay of a bit beyond its period
+
+    bool transmitWindows(const uint32_t *wire, uint32_t bits);
+    void recordWindow(uint32_t cycles);
+};
+
+/**
+ * @brief Cycle counted transmission of up to 8 strips on different pins (GPIO0 - GPIO15)
+ * in one pass. All pins are set with one write of GPIO_OUT_W1TS and cleared with
+ * GPIO_OUT_W1TC, so N strips of length L block the CPU as long as one strip.
+ *
+ * Each strip gets a lane output (createOutput()). Its transmit() only copies the frame,
+ * the frames of all lanes are sent by transmit() of the group:
+ * ``` cpp
+ * strip0.show(); strip1.show();   // hand the frames to the lanes
+ * group.transmit();               // send both at once
+ * ```
+ * A lane without a new frame keeps its pin low. The group must outlive the strips.
+ */
+class ParallelBitBang {
+public:
+    static constexpr uint8_t MAX_LANES = 8;
+
+    ParallelBitBang(const gpio_num_t *pins, uint8_t laneCount);
+    ~ParallelBitBang();
+    std::unique_ptr<Ws2812Output> createOutput(uint8_t lane);
+    bool transmit();
+    bool isReady() const;
+    uint8_t getLaneCount() const { return laneCount; }
+    uint32_t getTransmitCycles() const { return transmitCycles; }
+
+private:
+    class LaneOutput;
+
+    struct Lane {
+        uint32_t pinMask;
+        std::vector<uint32_t> wire;     // copy of the last frame of the strip
+        uint32_t bits;                  // of the pending frame, 0 if there is none
+        LaneOutput *output;
+    };
+
+    const uint8_t laneCount;
+    Lane lanes[MAX_LANES];
+    uint32_t pinMasks[1 << MAX_LANES];  // pins of a byte of the transposed stream
+    std::vector<uint8_t> transposed;    // one byte per bit, bit n is lane n
+    uint32_t transmitCycles;            // of the last transmit()
+    RtosTimestamp lastShow;
+
+    void send(uint32_t bits, const uint32_t *endBits, const uint32_t *endPins);
+};
+
+/**
+ * @brief Transmission with the I2S peripheral and DMA. The data is sent on
+ * the I2S data out pin (GPIO3 / RX) at 3.2 MHz, 4 I2S bits per WS2812 bit.
+ * transmit() only copies the encoded frame into the DMA buffers.
+ */
+class I2sDmaOutput : public Ws2812Output {
+public:
+    I2sDmaOutput(uint16_t maxBytes);
+    ~I2sDmaOutput() override;
+    bool transmit(const uint32_t *wire, uint32_t bits) override;
+    bool isReady() const override;
+
+private:
+    std::vector<uint32_t> buffer;
+    QueueHandle_t eventQueue;
+    TaskHandle_t eventTask;
+    volatile uint32_t pendingBuffers;   // TX done events until the frame is completed
+    uint32_t bufferBytes;
+    uint32_t dmaBuffers;                // in the ring of the driver
+
+    static void eventTaskFunction(void *arg);
+};
+
+/**
+ * @brief Transmission with the UART1 TX pin (GPIO2) at 3.2 Mbaud, 6N1 with
+ * inverted line. Each character encodes 2 WS2812 bits. transmit() only copies
+ * the encoded frame into the TX ring buffer of the UART driver.
+ */
+class UartOutput : public Ws2812Output {
+public:
+    UartOutput(uint16_t maxBytes);
+    ~UartOutput() override;
+    bool transmit(const uint32_t *wire, uint32_t bits) override;
+    bool isReady() const override;
+
+private:
+    std::vector<uint8_t> buffer;
+    mutable bool sending;
+    mutable RtosTimestamp sentAt;
+};
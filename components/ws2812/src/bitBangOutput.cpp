@@ -0,0 +1,221 @@
+#include "ws2812.hpp"
+#include "ws2812Hal.hpp"
+#include "ws2812Output.hpp"
+
+/**
+ * @brief Activate the pin as output.
+ *
+ * @param pin to which the strip is connected
+ */
+BitBangOutput::BitBangOutput(gpio_num_t pin)
+    : pin(pin),
+      lastShow(RtosTimestamp()),
+      windowBits(0),
+      maxGapCycles(0)
+{
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pin_bit_mask = 1ULL << pin;
+    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpio_config(&io_conf);
+}
+
+/**
+ * @brief Sets the pin mode to input.
+ *
+ */
+BitBangOutput::~BitBangOutput()
+{
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = 1ULL << pin;
+    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpio_config(&io_conf);
+}
+
+/**
+ * @brief Enable the interrupts between the pixels.
+ * The latch threshold of the strip is the shortest low time which resets it,
+ * about 6us for a WS2812B and up to 280us for newer revisions. The maximum gap
+ * must stay below it, a bit takes up to 1.25us of the threshold itself.
+ *
+ * @param pixelBits bits per pixel (24 or 32), the interrupts are enabled after each pixel. 0 disables the mode.
+ * @param maxGapUs longest delay of a bit beyond its period, a longer delay retries the frame
+ */
+void BitBangOutput::setInterruptible(uint8_t pixelBits, uint32_t maxGapUs)
+{
+    windowBits = pixelBits;
+    maxGapCycles = maxGapUs * (F_CPU / 1000000);
+}
+
+/**
+ * @brief Shift out count bits of the bitstream, starting at bit first. The MSB of
+ * each word decides the high time of the bit. Must be called with disabled interrupts.
+ *
+ * @param startTime cycle count at the start of the previous bit, the first bit waits until its period is over
+ * @return cycle count at the start of the last bit
+ */
+static inline __attribute__((always_inline)) uint32_t sendBits(uint32_t pinMask, const uint32_t *wire,
+                                                               uint32_t first, uint32_t count, uint32_t startTime)
+{
+    uint32_t t, time0 = CYCLES_800_T0H, time1 = CYCLES_800_T1H, period = CYCLES_800, c;
+    const uint32_t *word = wire + first / 32;
+    uint32_t bits = *word++ << (first % 32);
+    uint32_t left = 32 - first % 32;
+
+    for (; count; --count)
+    {
+        if (left == 0)
+        {
+            bits = *word++;
+            left = 32;
+        }
+        t = ((int32_t)bits < 0) ? time1 : time0;
+        bits <<= 1;
+        left--;
+        while (((c = ws2812hal::cycleCount()) - startTime) < period)
+            ;
+        ws2812hal::pinSet(pinMask);
+        startTime = c;
+        while ((ws2812hal::cycleCount() - startTime) < t)
+            ;
+        ws2812hal::pinClear(pinMask);
+    }
+    return startTime;
+}
+
+/**
+ * @brief Cycles since a cycle count which was read with disabled interrupts in the given tick.
+ * The tick interrupt resets the ccount register when it reaches CYCLES_PER_TICK, a tick which
+ * was pending during the critical section resets it as soon as the interrupts are enabled.
+ */
+static inline __attribute__((always_inline)) uint32_t cyclesSince(TickType_t ticks, uint32_t count)
+{
+    TickType_t ticksNow = xTaskGetTickCount();
+    uint32_t now = ws2812hal::cycleCount();
+    if (ticksNow == ticks)
+    {
+        return now - count;
+    }
+    uint32_t reset = count > CYCLES_PER_TICK ? count : CYCLES_PER_TICK;
+    return reset - count + (ticksNow - ticks - 1) * CYCLES_PER_TICK + now;
+}
+
+/**
+ * @brief Write the bitstream to the pin.
+ *
+ * As the ccount register is reset by the ccompare interrupt, some aspects have to be considered.
+ * The ccount register only counts up to the defined interrupt frequency (normally 100ms). At that
+ * point the ccompare interrupt is triggered which resets the ccount register
+ * (https://github.com/espressif/ESP8266_RTOS_SDK/issues/750#issuecomment-549261167).
+ * As the ccount register is important for the time critical transmission of the data to the strip,
+ * an overflow check has to be made. This corrects the timing.
+ * However, as no context switch should occur during the transmission, the transmission is wrapped
+ * in a critical section. You can control up to which priority interrupts should be handled
+ * by setting the configMAX_SYSCALL_INTERRUPT_PRIORITY and configMAX_API_CALL_INTERRUPT_PRIORITY.
+ * For more details see the FreeRTOS documentation (https://freertos.org/taskENTER_CRITICAL_taskEXIT_CRITICAL.html,
+ * https://freertos.org/a00110.html#kernel_priority)
+ *
+ * Inside of the critical section only the precomputed words are shifted out.
+ * In the interruptible mode there is one critical section per pixel (see transmitWindows()).
+ *
+ * @return always true, the frame is sent when the function returns
+ */
+IRAM_ATTR bool BitBangOutput::transmit(const uint32_t *wire, uint32_t remaining)
+{
+    criticalStats.frameMaxCycles = 0;
+    bool sent = false;
+    for (uint8_t attempt = 0; windowBits && !sent && attempt <= MAX_RETRIES; attempt++)
+    {
+        // the strip must latch the partial frame before it is sent again
+        while (!isReady())
+            ;
+        sent = transmitWindows(wire, remaining);
+        if (!sent)
+        {
+            criticalStats.gapOverflows++;
+        }
+    }
+
+    if (!sent)
+    {
+        if (windowBits)
+        {
+            criticalStats.fallbacks++;
+            while (!isReady())
+                ;
+        }
+        ws2812hal::enterCritical();
+        uint32_t windowStart = ws2812hal::cycleCount();
+        uint32_t startTime = sendBits(1UL << pin, wire, 0, remaining, 0);
+
+        // Ensure the final bit period is complete
+        while ((ws2812hal::cycleCount() - startTime) < CYCLES_800)
+            ;
+        uint32_t window = ws2812hal::cycleCount() - windowStart;
+        ws2812hal::exitCritical();
+        recordWindow(window);
+    }
+
+    lastShow.update();
+    notifyDone();
+    return true;
+}
+
+/**
+ * @brief Send the bitstream with enabled interrupts between the pixels.
+ * The delay of the first bit of each pixel is checked before it is sent.
+ *
+ * @return false if a delay exceeded the maximum gap, the strip got a partial frame
+ */
+IRAM_ATTR bool BitBangOutput::transmitWindows(const uint32_t *wire, uint32_t bits)
+{
+    const uint32_t pinMask = 1UL << pin;
+    uint32_t startTime = 0;
+    TickType_t ticks = 0;
+
+    for (uint32_t first = 0; first < bits; first += windowBits)
+    {
+        uint32_t count = bits - first < windowBits ? bits - first : windowBits;
+
+        ws2812hal::enterCritical();
+        uint32_t windowStart = ws2812hal::cycleCount();
+        if (first && cyclesSince(ticks, startTime) > CYCLES_800 + maxGapCycles)
+        {
+            ws2812hal::exitCritical();
+            lastShow.update();
+            return false;
+        }
+        startTime = sendBits(pinMask, wire, first, count, startTime);
+        ticks = xTaskGetTickCount();
+        uint32_t window = ws2812hal::cycleCount() - windowStart;
+        ws2812hal::exitCritical();
+        recordWindow(window);
+    }
+
+    // the final bit period, an interrupt only extends the latch
+    while (cyclesSince(ticks, startTime) < CYCLES_800)
+        ;
+    return true;
+}
+
+IRAM_ATTR void BitBangOutput::recordWindow(uint32_t cycles)
+{
+    if (cycles > criticalStats.frameMaxCycles)
+    {
+        criticalStats.frameMaxCycles = cycles;
+    }
+    if (cycles > criticalStats.maxCycles)
+    {
+        criticalStats.maxCycles = cycles;
+    }
+}
+
+IRAM_ATTR bool BitBangOutput::isReady() const
+{
+    return lastShow.tickDiff() > CYCLES_RESET;
+}
@@ -0,0 +1,95 @@
+#include "ColorLut.hpp"
+
+/**
+ * Gamma 2.8 table: round((i / 255) ^ 2.8 * 255).
+ * The table is constant, so it is placed in the flash rodata. As the ESP8266
+ * can only read 32 bit words from the flash without an exception, it is
+ * aligned and read word wise when the tables are rebuilt.
+ */
+static const uint8_t gammaTable[256] __attribute__((aligned(4))) = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+ColorLut::ColorLut()
+    : brightness(255),
+      gamma(false),
+      balance{255, 255, 255, 255},
+      outdated(true)
+{
+    update();
+}
+
+void ColorLut::setBrightness(uint8_t brightness)
+{
+    outdated |= this->brightness != brightness;
+    this->brightness = brightness;
+}
+
+/**
+ * @brief Enable or disable the gamma correction. It is disabled by default,
+ * so the colors are sent unchanged like before the lookup tables.
+ */
+void ColorLut::setGammaCorrection(bool enabled)
+{
+    outdated |= gamma != enabled;
+    gamma = enabled;
+}
+
+/**
+ * @brief Set the white balance calibration. Each channel is scaled by value / 255,
+ * so the brightest channel of the strip should be reduced.
+ */
+void ColorLut::setWhiteBalance(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    outdated |= balance[0] != r || balance[1] != g || balance[2] != b || balance[3] != w;
+    balance[0] = r;
+    balance[1] = g;
+    balance[2] = b;
+    balance[3] = w;
+}
+
+/**
+ * @brief Rebuild the tables if a parameter changed since the last call.
+ *
+ * @return true if the tables were rebuilt
+ */
+bool ColorLut::update()
+{
+    if (!outdated)
+    {
+        return false;
+    }
+
+    const uint32_t *gammaWords = reinterpret_cast<const uint32_t *>(gammaTable);
+    for (uint16_t value = 0; value < 256; value += 4)
+    {
+        uint32_t word = gammaWords[value / 4];
+        for (uint8_t byte = 0; byte < 4; byte++)
+        {
+            uint32_t corrected = gamma ? (word >> (8 * byte) & 0xff) : value + byte;
+            for (uint8_t stored = 0; stored < 4; stored++)
+            {
+                // scale by balance / 255 and brightness / 255 with rounding
+                tables[stored][value + byte] = (corrected * balance[stored] * brightness + 32512) / 65025;
+            }
+        }
+    }
+
+    outdated = false;
+    return true;
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include "ws2812.hpp"
+#include "ws2812Encoders.hpp"
+#include "ws2812Output.hpp"
+#include "driver/i2s.h"
+#include "esp_log.h"
+
+#define I2S_PORT I2S_NUM_0
+#define I2S_DMA_BUF_LEN 256     // samples, each sample has 2 * 16 bit
+#define I2S_DMA_BUF_BYTES (I2S_DMA_BUF_LEN * 4)
+
+static const char *TAG = "I2sDmaOutput";
+
+/**
+ * @brief Install the I2S driver with enough DMA buffers for a whole frame,
+ * so transmit() never has to wait for the DMA. The driver only hands out the
+ * buffers which the DMA completed, one more buffer is in flight.
+ *
+ * @param maxBytes size of the largest frame in bytes (pixels * leds per pixel)
+ */
+I2sDmaOutput::I2sDmaOutput(uint16_t maxBytes)
+    : buffer(std::vector<uint32_t>()),
+      eventQueue(NULL),
+      eventTask(NULL),
+      pendingBuffers(0),
+      bufferBytes(I2S_DMA_BUF_BYTES),
+      dmaBuffers(0)
+{
+    size_t words = ws2812encoder::i2sWords(maxBytes * 8) + ws2812encoder::I2S_RESET_WORDS;
+    size_t buffers = (words * 4 + bufferBytes - 1) / bufferBytes;
+    buffer.resize(buffers * bufferBytes / 4);
+
+    i2s_config_t i2s_config;
+    i2s_config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX);
+    i2s_config.sample_rate = ws2812encoder::BIT_CLOCK / 32;
+    i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    i2s_config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    i2s_config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+    i2s_config.intr_alloc_flags = 0;
+    i2s_config.dma_buf_count = buffers + 1;
+    i2s_config.dma_buf_len = I2S_DMA_BUF_LEN;
+    i2s_config.tx_desc_auto_clear = true;
+
+    i2s_pin_config_t pin_config;
+    pin_config.bck_o_en = 0;
+    pin_config.ws_o_en = 0;
+    pin_config.bck_i_en = 0;
+    pin_config.ws_i_en = 0;
+    pin_config.data_out_en = 1;
+    pin_config.data_in_en = 0;
+
+    dmaBuffers = i2s_config.dma_buf_count;
+    ESP_ERROR_CHECK(i2s_driver_install(I2S_PORT, &i2s_config, i2s_config.dma_buf_count, &eventQueue));
+    ESP_ERROR_CHECK(i2s_set_pin(I2S_PORT, &pin_config));
+
+    if (xTaskCreate(eventTaskFunction, "i2sOutput", 1024, this, 10, &eventTask) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the I2S event task");
+    }
+}
+
+I2sDmaOutput::~I2sDmaOutput()
+{
+    if (eventTask)
+    {
+        vTaskDelete(eventTask);
+    }
+    i2s_driver_uninstall(I2S_PORT);
+}
+
+/**
+ * @brief Waits for the TX done events of the DMA. The DMA sends the zeroed buffers
+ * between the frames as well, each of them raises an event. The frame is completed
+ * after the events which transmit() expects for it (see there).
+ */
+void I2sDmaOutput::eventTaskFunction(void *arg)
+{
+    auto self = static_cast<I2sDmaOutput *>(arg);
+    i2s_event_t event;
+
+    while (1)
+    {
+        if (xQueueReceive(self->eventQueue, &event, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        if (event.type == I2S_EVENT_TX_DONE && self->pendingBuffers > 0)
+        {
+            if (--self->pendingBuffers == 0)
+            {
+                self->notifyDone();
+            }
+        }
+        else if (event.type == I2S_EVENT_DMA_ERROR)
+        {
+            ESP_LOGE(TAG, "DMA error");
+        }
+    }
+}
+
+/**
+ * @brief Encode the frame and copy it into the DMA buffers. The frame is padded
+ * with zeros to full DMA buffers, which also generates the reset time.
+ *
+ * The events do not tell which buffer was sent. Before the written buffers the
+ * DMA sends at most the other buffers of the ring, and the event task may still
+ * count one event from before the write. So the frame is completed after its
+ * buffers plus the buffers of the ring, which may be up to one ring late.
+ *
+ * @return false if the previous frame is still sent, the frame is too large or
+ * the driver did not queue all of it
+ */
+bool I2sDmaOutput::transmit(const uint32_t *wire, uint32_t bits)
+{
+    size_t words = ws2812encoder::i2sWords(bits);
+    if (!isReady() || words + ws2812encoder::I2S_RESET_WORDS > buffer.size())
+    {
+        return false;
+    }
+
+    ws2812encoder::encodeI2s(wire, bits, buffer.data());
+    size_t usedBuffers = ((words + ws2812encoder::I2S_RESET_WORDS) * 4 + bufferBytes - 1) / bufferBytes;
+    size_t bytes = usedBuffers * bufferBytes;
+    std::fill(buffer.begin() + words, buffer.begin() + bytes / 4, 0);
+
+    // events of the zeroed buffers before the write are not counted
+    xQueueReset(eventQueue);
+    pendingBuffers = usedBuffers + dmaBuffers;
+    size_t written = 0;
+    if (i2s_write(I2S_PORT, buffer.data(), bytes, &written, 0) != ESP_OK || written != bytes)
+    {
+        ESP_LOGW(TAG, "Only %d of %d bytes queued", written, bytes);
+        // the queued part is still sent, the next frame waits for it
+        size_t writtenBuffers = (written + bufferBytes - 1) / bufferBytes;
+        pendingBuffers = writtenBuffers ? writtenBuffers + dmaBuffers : 0;
+        return false;
+    }
+    return true;
+}
+
+bool I2sDmaOutput::isReady() const
+{
+    return pendingBuffers == 0;
+}
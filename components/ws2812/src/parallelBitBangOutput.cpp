@@ -0,0 +1,251 @@
+#include <string.h>
+#include "ws2812.hpp"
+#include "ws2812Encoders.hpp"
+#include "ws2812Hal.hpp"
+#include "ws2812Output.hpp"
+#include "esp_log.h"
+
+static const char *TAG = "ParallelBitBang";
+
+/**
+ * @brief Output of one strip of the group. transmit() copies the frame into the lane,
+ * it is sent by ParallelBitBang::transmit(). The lane is not ready while its frame is
+ * pending, so the strip keeps a newer frame in its back buffer until then.
+ */
+class ParallelBitBang::LaneOutput : public Ws2812Output {
+public:
+    LaneOutput(ParallelBitBang &group, uint8_t lane) : group(group), lane(lane)
+    {
+        group.lanes[lane].output = this;
+    }
+
+    ~LaneOutput() override
+    {
+        group.lanes[lane].output = nullptr;
+        group.lanes[lane].bits = 0;
+    }
+
+    bool transmit(const uint32_t *wire, uint32_t bits) override
+    {
+        Lane &target = group.lanes[lane];
+        const size_t words = (bits + 31) / 32;
+        if (target.wire.size() < words)
+        {
+            target.wire.resize(words);
+        }
+        memcpy(target.wire.data(), wire, words * sizeof(uint32_t));
+        target.bits = bits;
+        return true;
+    }
+
+    bool isReady() const override
+    {
+        return group.lanes[lane].bits == 0 && group.isReady();
+    }
+
+    void done() const
+    {
+        notifyDone();
+    }
+
+private:
+    ParallelBitBang &group;
+    const uint8_t lane;
+};
+
+/**
+ * @brief Activate the pins as outputs.
+ *
+ * @param pins of the strips, lane n is connected to pins[n]. Only GPIO0 - GPIO15 can be
+ * written with GPIO_OUT_W1TS/W1TC, a lane on another pin stays inactive.
+ * @param laneCount number of pins (up to MAX_LANES)
+ */
+ParallelBitBang::ParallelBitBang(const gpio_num_t *pins, uint8_t laneCount)
+    : laneCount(laneCount < MAX_LANES ? laneCount : MAX_LANES),
+      lanes{},
+      transmitCycles(0),
+      lastShow(RtosTimestamp())
+{
+    uint32_t allPins = 0;
+    for (uint8_t lane = 0; lane < this->laneCount; lane++)
+    {
+        if (pins[lane] >= GPIO_NUM_16)
+        {
+            ESP_LOGE(TAG, "GPIO%d can not be used for lane %d", pins[lane], lane);
+            continue;
+        }
+        lanes[lane].pinMask = 1UL << pins[lane];
+        allPins |= lanes[lane].pinMask;
+    }
+
+    for (uint32_t mask = 0; mask < (1 << MAX_LANES); mask++)
+    {
+        pinMasks[mask] = 0;
+        for (uint8_t lane = 0; lane < this->laneCount; lane++)
+        {
+            if (mask & (1 << lane))
+            {
+                pinMasks[mask] |= lanes[lane].pinMask;
+            }
+        }
+    }
+
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pin_bit_mask = allPins;
+    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpio_config(&io_conf);
+}
+
+/**
+ * @brief Sets the pins mode to input.
+ */
+ParallelBitBang::~ParallelBitBang()
+{
+    uint32_t allPins = 0;
+    for (uint8_t lane = 0; lane < laneCount; lane++)
+    {
+        allPins |= lanes[lane].pinMask;
+    }
+
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = allPins;
+    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpio_config(&io_conf);
+}
+
+/**
+ * @brief Create the output of a lane, which is passed to the WS2812 constructor.
+ * Only one output per lane may exist.
+ */
+std::unique_ptr<Ws2812Output> ParallelBitBang::createOutput(uint8_t lane)
+{
+    return std::make_unique<LaneOutput>(*this, lane);
+}
+
+/**
+ * @brief Send the pending frames of all lanes in one pass. The lanes are transposed
+ * before the critical section, afterwards the done callbacks of the lanes are called.
+ *
+ * @return false if no lane has a pending frame or the reset time is not completed
+ */
+bool ParallelBitBang::transmit()
+{
+    if (!isReady())
+    {
+        return false;
+    }
+
+    const uint32_t *wires[MAX_LANES];
+    uint32_t bits[MAX_LANES];
+    uint32_t maxBits = 0;
+    // bit index at which the lanes end, ascending, terminated by UINT32_MAX
+    uint32_t endBits[MAX_LANES + 1];
+    uint32_t endPins[MAX_LANES + 1];
+    uint8_t ends = 0;
+
+    for (uint8_t lane = 0; lane < laneCount; lane++)
+    {
+        bits[lane] = lanes[lane].pinMask ? lanes[lane].bits : 0;
+        wires[lane] = bits[lane] ? lanes[lane].wire.data() : nullptr;
+        if (bits[lane] == 0)
+        {
+            continue;
+        }
+        maxBits = bits[lane] > maxBits ? bits[lane] : maxBits;
+
+        uint8_t position = ends++;
+        for (; position > 0 && endBits[position - 1] > bits[lane]; position--)
+        {
+            endBits[position] = endBits[position - 1];
+            endPins[position] = endPins[position - 1];
+        }
+        endBits[position] = bits[lane];
+        endPins[position] = lanes[lane].pinMask;
+    }
+    endBits[ends] = UINT32_MAX;
+    endPins[ends] = 0;
+
+    if (maxBits == 0)
+    {
+        return false;
+    }
+
+    if (transposed.size() < maxBits)
+    {
+        transposed.resize(maxBits);
+    }
+    ws2812encoder::transposeLanes(wires, bits, laneCount, maxBits, transposed.data());
+
+    uint32_t start = ws2812hal::cycleCount();
+    send(maxBits, endBits, endPins);
+    transmitCycles = ws2812hal::cycleCount() - start;
+    lastShow.update();
+
+    for (uint8_t lane = 0; lane < laneCount; lane++)
+    {
+        if (bits[lane])
+        {
+            lanes[lane].bits = 0;
+            if (lanes[lane].output)
+            {
+                lanes[lane].output->done();
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Write the transposed stream to the pins, see BitBangOutput::transmit() for the
+ * critical section. Every bit sets the pins of the active lanes, clears the lanes which
+ * send a zero after T0H and the others after T1H. A lane which ended stays low.
+ */
+IRAM_ATTR void ParallelBitBang::send(uint32_t bits, const uint32_t *endBits, const uint32_t *endPins)
+{
+    uint32_t time0 = CYCLES_800_T0H, time1 = CYCLES_800_T1H, period = CYCLES_800, startTime = 0, c;
+    const uint8_t *stream = transposed.data();
+    uint32_t active = 0;
+    for (const uint32_t *pins = endPins; *pins; pins++)
+    {
+        active |= *pins;
+    }
+
+    ws2812hal::enterCritical();
+    for (uint32_t bit = 0; bit < bits; bit++)
+    {
+        while (bit == *endBits)
+        {
+            active &= ~*endPins++;
+            endBits++;
+        }
+        uint32_t ones = pinMasks[stream[bit]];
+
+        while (((c = ws2812hal::cycleCount()) - startTime) < period)
+            ;
+        ws2812hal::pinSet(active);
+        startTime = c;
+        while ((ws2812hal::cycleCount() - startTime) < time0)
+            ;
+        ws2812hal::pinClear(active & ~ones);
+        while ((ws2812hal::cycleCount() - startTime) < time1)
+            ;
+        ws2812hal::pinClear(ones);
+    }
+
+    // Ensure the final bit period is complete
+    while ((ws2812hal::cycleCount() - startTime) < period)
+        ;
+
+    ws2812hal::exitCritical();
+}
+
+IRAM_ATTR bool ParallelBitBang::isReady() const
+{
+    return lastShow.tickDiff() > CYCLES_RESET;
+}
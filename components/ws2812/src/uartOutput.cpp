@@ -0,0 +1,70 @@
+#include "ws2812.hpp"
+#include "ws2812Encoders.hpp"
+#include "ws2812Output.hpp"
+#include "driver/uart.h"
+#include "esp_log.h"
+
+#define UART_PORT UART_NUM_1
+
+/**
+ * @brief Configure UART1 for 3.2 Mbaud, 6N1 with inverted TX line and install the
+ * driver with a TX ring buffer which is large enough for a whole frame.
+ *
+ * @param maxBytes size of the largest frame in bytes (pixels * leds per pixel)
+ */
+UartOutput::UartOutput(uint16_t maxBytes)
+    : buffer(std::vector<uint8_t>(ws2812encoder::uartBytes(maxBytes * 8))),
+      sending(false),
+      sentAt(RtosTimestamp())
+{
+    uart_config_t uart_config;
+    uart_config.baud_rate = ws2812encoder::BIT_CLOCK;
+    uart_config.data_bits = UART_DATA_6_BITS;
+    uart_config.parity = UART_PARITY_DISABLE;
+    uart_config.stop_bits = UART_STOP_BITS_1;
+    uart_config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    uart_config.rx_flow_ctrl_thresh = 0;
+
+    ESP_ERROR_CHECK(uart_param_config(UART_PORT, &uart_config));
+    ESP_ERROR_CHECK(uart_driver_install(UART_PORT, UART_FIFO_LEN * 2, buffer.size() + UART_FIFO_LEN + 1, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_set_line_inverse(UART_PORT, UART_INVERSE_TXD));
+}
+
+UartOutput::~UartOutput()
+{
+    uart_driver_delete(UART_PORT);
+}
+
+/**
+ * @brief Encode the frame and copy it into the TX ring buffer.
+ *
+ * @return false if the previous frame is still sent or the frame is too large
+ */
+bool UartOutput::transmit(const uint32_t *wire, uint32_t bits)
+{
+    size_t bytes = ws2812encoder::uartBytes(bits);
+    if (!isReady() || bytes > buffer.size())
+    {
+        return false;
+    }
+
+    ws2812encoder::encodeUart(wire, bits, buffer.data());
+    sending = true;
+    uart_write_bytes(UART_PORT, (const char *)buffer.data(), bytes);
+    return true;
+}
+
+/**
+ * @brief The UART has no DMA, so the completion is detected here: once the TX
+ * FIFO is empty the done callback is called and the reset time starts.
+ */
+bool UartOutput::isReady() const
+{
+    if (sending && uart_wait_tx_done(UART_PORT, 0) == ESP_OK)
+    {
+        sending = false;
+        sentAt.update();
+        notifyDone();
+    }
+    return !sending && sentAt.tickDiff() > CYCLES_RESET;
+}
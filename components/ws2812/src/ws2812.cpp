@@ -1,162 +1,337 @@
 #include "ws2812.hpp"
+#include "ws2812Hal.hpp"
 #include "esp_log.h"
 
 /**
- * @brief Create a new pixel strip. The pin is activated as output, and
- * each pixel is initialized to black (off). The brightness is set to 255.
+ * @brief Limit the number of pixels to the capacity of the buffers in the static
+ * allocation mode (CONFIG_ESP_WS2812_STATIC_ALLOCATION).
+ */
+static uint16_t fitPixels(uint16_t numPixels, [[maybe_unused]] uint8_t numLedsPerPixel)
+{
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+    if ((size_t)numPixels * numLedsPerPixel > WS2812::MAX_PIXEL_BYTES)
+    {
+        ESP_LOGE("WS2812", "%u pixels do not fit into the static buffers, the strip is cut to %u pixels",
+                 numPixels, (unsigned)(WS2812::MAX_PIXEL_BYTES / numLedsPerPixel));
+        return WS2812::MAX_PIXEL_BYTES / numLedsPerPixel;
+    }
+#endif
+    return numPixels;
+}
+
+/**
+ * @brief Create a new pixel strip which is driven by the BitBangOutput.
+ * The pin is activated as output, and each pixel is initialized to black (off).
+ * The brightness is set to 255.
  *
  * @param pin to which the strip is connected
  * @param numPixels number of LEDs in the strip
  * @param order defines the strip and the color order. For more details see the PixelOrder enum.
  */
 WS2812::WS2812(gpio_num_t pin, uint16_t numPixels, PixelOrder::PixelOrder order)
-    : pin(pin),
-      numPixels(numPixels),
+    : WS2812(std::make_unique<BitBangOutput>(pin), numPixels, order)
+{
+}
+
+/**
+ * @brief Create a new pixel strip which is driven by the given output.
+ * Each pixel is initialized to black (off). The brightness is set to 255.
+ *
+ * @param output transport to the strip (see ws2812Output.hpp)
+ * @param numPixels number of LEDs in the strip
+ * @param order defines the strip and the color order. For more details see the PixelOrder enum.
+ */
+WS2812::WS2812(std::unique_ptr<Ws2812Output> output, uint16_t numPixels, PixelOrder::PixelOrder order)
+    : WS2812(std::move(output), numPixels, order, encodeRuntime)
+{
+}
+
+/**
+ * @brief Constructor for derived classes which provide a specialized encoder
+ * (see FixedOrderWS2812).
+ */
+WS2812::WS2812(std::unique_ptr<Ws2812Output> output, uint16_t numPixels, PixelOrder::PixelOrder order, Encoder encoder)
+    : numPixels(fitPixels(numPixels, PixelOrder::hasWhite(order) ? 4 : 3)),
+      numLedsPerPixel(PixelOrder::hasWhite(order) ? 4 : 3),
+      lut(),
+      pixels(this->numPixels * numLedsPerPixel),
+      dirtyEnd(this->numPixels),
+      output(std::move(output)),
       offW(order >> 9 & 0b111),
       offR(order >> 6 & 0b111),
       offG(order >> 3 & 0b111),
       offB(order & 0b111),
-      numLedsPerPixel(3),
-      brightness(255),
-      pixels(std::vector<uint8_t>(numPixels * numLedsPerPixel)),
-      lastShow(RtosTimestamp())
+      encoder(encoder),
+      wire{WireBuffer((this->numPixels * numLedsPerPixel + 3) / 4),
+           WireBuffer((this->numPixels * numLedsPerPixel + 3) / 4)},
+      wireBits(this->numPixels * numLedsPerPixel * 8),
+      pendingBits(0),
+      front(0),
+      pending(false),
+      frontShown(false),
+      frameQueue(xQueueCreate(1, sizeof(uint8_t))),
+      showStats{0, 0, 0, 0, 0},
+      frameCounters{0, 0, 0, 0}
 {
-    enablePin(pin);
 }
 
-void WS2812::enablePin(gpio_num_t pin) const
+WS2812::~WS2812()
 {
-    gpio_config_t io_conf;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = 1ULL << pin;
-    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    gpio_config(&io_conf);
+    vQueueDelete(frameQueue);
 }
 
-void WS2812::disablePin(gpio_num_t pin) const
+/**
+ * @brief Set the color of the whole strip to black (off).
+ *
+ */
+void WS2812::clear()
 {
-    gpio_config_t io_conf;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = 1ULL << pin;
-    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    gpio_config(&io_conf);
+    fill(RgbColor(0, 0, 0));
 }
 
 /**
- * @brief Destructor for the WS2812 class.
- * Cleans up the memory allocated for the pixels and sets the pin mode to input.
- *
+ * @brief Convert the pixels into the bitstream which is sent to the strip.
+ * The color lookup tables and the color order are applied here, so the transmission
+ * only has to shift out the prepared words. The offsets are decoded at runtime,
+ * FixedOrderWS2812 provides encoders with compile time offsets.
  */
-WS2812::~WS2812(void)
+void WS2812::encodeRuntime(const WS2812 &strip, uint32_t *out)
 {
-    gpio_config_t io_conf;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = 1ULL << pin;
-    io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    gpio_config(&io_conf);
+    uint32_t word = 0;
+    uint8_t bytesInWord = 0;
+    uint8_t ordered[4];
+    const uint8_t numLedsPerPixel = strip.numLedsPerPixel;
+    const uint8_t *lutR = strip.lut.channel(0);
+    const uint8_t *lutG = strip.lut.channel(1);
+    const uint8_t *lutB = strip.lut.channel(2);
+    const uint8_t *lutW = strip.lut.channel(3);
+
+    for (auto it = strip.pixels.cbegin(); it != strip.pixels.cend(); it += numLedsPerPixel)
+    {
+        ordered[strip.offR] = lutR[it[0]];
+        ordered[strip.offG] = lutG[it[1]];
+        ordered[strip.offB] = lutB[it[2]];
+        if (numLedsPerPixel == 4)
+        {
+            ordered[strip.offW] = lutW[it[3]];
+        }
+
+        for (uint8_t led = 0; led < numLedsPerPixel; led++)
+        {
+            word = word << 8 | ordered[led];
+            if (++bytesInWord == 4)
+            {
+                *out++ = word;
+                bytesInWord = 0;
+            }
+        }
+    }
+
+    if (bytesInWord)
+    {
+        *out = word << (8 * (4 - bytesInWord));
+    }
 }
 
 /**
- * @brief Set the color of the whole strip to black (off).
+ * @brief Encode the pixels into the back wire buffer and mark it as pending.
+ * A pending frame which was not transmitted yet is replaced. The transmitting
+ * task is woken up (see waitForFrame()).
  *
+ * The frame is skipped without encoding if no pixel was written and the color
+ * lookup tables did not change since the last present(). An encoded frame which
+ * is identical to the frame on the strip is dropped as well.
  */
-void WS2812::clear()
+void WS2812::present()
 {
-    fill(RgbColor(0, 0, 0));
+    uint32_t encodeStart = ws2812hal::cycleCount();
+
+    frameCounters.framesPresented++;
+    bool lutChanged = lut.update();
+    if (!lutChanged && dirtyEnd == 0)
+    {
+        frameCounters.framesSkipped++;
+        return;
+    }
+    dirtyEnd = 0;
+
+    ws2812hal::enterCritical();
+    pending = false;
+    uint8_t back = front ^ 1;
+    ws2812hal::exitCritical();
+
+    encoder(*this, wire[back].data());
+    uint32_t bits = changedBits(back);
+
+    showStats.encodeCycles = ws2812hal::cycleCount() - encodeStart;
+
+    if (bits == 0)
+    {
+        frameCounters.framesSkipped++;
+        return;
+    }
+
+    ws2812hal::enterCritical();
+    pendingBits = bits;
+    pending = true;
+    ws2812hal::exitCritical();
+
+    uint8_t signal = 0;
+    xQueueSend(frameQueue, &signal, 0);
 }
 
 /**
- * @brief Write the rgb color to the pin.
- *
- * As the ccount register is reset by the ccompare interrupt, some aspects have to be considered.
- * The ccount register only counts up to the defined interrupt frequency (normally 100ms). At that
- * point the ccompare interrupt is triggered which resets the ccount register
- * (https://github.com/espressif/ESP8266_RTOS_SDK/issues/750#issuecomment-549261167).
- * As the ccount register is important for the time critical transmission of the data to the strip,
- * an overflow check has to be made. This corrects the timing.
- * However, as no context switch should occur during the transmission, the transmission is wrapped
- * in a critical section. You can control up to which priority interrupts should be handled
- * by setting the configMAX_SYSCALL_INTERRUPT_PRIORITY and configMAX_API_CALL_INTERRUPT_PRIORITY.
- * For more details see the FreeRTOS documentation (https://freertos.org/taskENTER_CRITICAL_taskEXIT_CRITICAL.html,
- * https://freertos.org/a00110.html#kernel_priority)
+ * @brief Compare the back wire buffer with the front wire buffer, which is the
+ * frame on the strip. The front buffer is only read, so this is safe while it
+ * is transmitted.
  *
+ * @return number of bits up to the end of the last changed pixel, 0 if the frames are identical
+ */
+uint32_t WS2812::changedBits(uint8_t back) const
+{
+    if (!frontShown)
+    {
+        return wireBits;
+    }
+
+    const uint32_t *next = wire[back].data();
+    const uint32_t *shown = wire[front].data();
+    size_t words = wire[back].size();
+    while (words && next[words - 1] == shown[words - 1])
+    {
+        words--;
+    }
+    if (words == 0)
+    {
+        return 0;
+    }
+
+    // the words are big endian, unchanged bytes at the end of the last word are the low bytes
+    uint32_t difference = next[words - 1] ^ shown[words - 1];
+    uint32_t changedBytes = words * 4 - __builtin_ctz(difference) / 8;
+    uint32_t bytesPerPixel = numLedsPerPixel;
+    uint32_t changedPixels = (changedBytes + bytesPerPixel - 1) / bytesPerPixel;
+    uint32_t bits = changedPixels * bytesPerPixel * 8;
+    return bits < wireBits ? bits : wireBits;
+}
+
+/**
+ * @brief Swap the wire buffers and pass the new front buffer to the output.
+ * This is the latch point, so the buffers are only swapped if the output is ready.
+ * Depending on the output the transmission is completed when the function
+ * returns (BitBangOutput) or continues in the background (I2sDmaOutput, UartOutput).
  *
- * @return
+ * @return false if no frame is pending or the output is not ready
  */
-IRAM_ATTR bool WS2812::show(void)
+bool WS2812::transmitPending()
 {
-    if (!isReady())
+    if (!output->isReady())
     {
         return false;
     }
 
-    uint8_t mask = 0x80;
-    uint32_t t, time0 = CYCLES_800_T0H, time1 = CYCLES_800_T1H, period = CYCLES_800, startTime = 0, c;
-    uint32_t pinMask = 1ULL << pin; // Assume 'pin' is defined elsewhere
+    ws2812hal::enterCritical();
+    bool swap = pending;
+    uint32_t bits = pendingBits;
+    if (swap)
+    {
+        front ^= 1;
+        pending = false;
+    }
+    ws2812hal::exitCritical();
 
-    taskENTER_CRITICAL();
-    for (auto it = pixels.cbegin(); it != pixels.cend(); ++it)
+    if (!swap)
     {
-        uint8_t pix = (*it) * brightness >> 8;
-        for (int bit = 0; bit < 8; ++bit)
-        {
-            t = (pix & mask) ? time1 : time0;
-            while (((c = xthal_get_ccount()) - startTime) < period)
-                ;
-            GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, pinMask);
-            startTime = c;
-            while (((xthal_get_ccount()) - startTime) < t)
-                ;
-            GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, pinMask);
-
-            mask >>= 1;
-            if (!mask)
-            {
-                mask = 0x80;
-            }
-        }
+        return false;
+    }
+
+    uint32_t transmitStart = ws2812hal::cycleCount();
+    bool sent = output->transmit(wire[front].data(), bits);
+    showStats.transmitCycles = ws2812hal::cycleCount() - transmitStart;
+    showStats.wireCycles = bits * CYCLES_800;
+    showStats.totalTransmitCycles += showStats.transmitCycles;
+    if (showStats.transmitCycles > showStats.maxTransmitCycles)
+    {
+        showStats.maxTransmitCycles = showStats.transmitCycles;
     }
 
-    // Ensure the final bit period is complete
-    while ((xthal_get_ccount() - startTime) < period)
-        ;
+    frameCounters.framesTransmitted++;
+    frameCounters.bytesSaved += (wireBits - bits) / 8;
+    frontShown = sent && (frontShown || bits == wireBits);
+    return sent;
+}
+
+/**
+ * @brief Block until a frame was presented.
+ *
+ * @param ticksToWait maximum time to wait
+ * @return true if a frame was presented
+ */
+bool WS2812::waitForFrame(TickType_t ticksToWait)
+{
+    uint8_t signal;
+    return xQueueReceive(frameQueue, &signal, ticksToWait) == pdTRUE;
+}
 
-    taskEXIT_CRITICAL();
+/**
+ * @brief Present the pixels and transmit them immediately.
+ *
+ * @return false if the strip is not ready (previous frame or reset time not completed)
+ */
+bool WS2812::show(void)
+{
+    if (!isReady())
+    {
+        return false;
+    }
 
-    lastShow.update();
-    return true;
+    present();
+    return transmitPending();
 }
 
-IRAM_ATTR bool WS2812::isReady() const
+bool WS2812::isReady() const
 {
-    return lastShow.tickDiff() > CYCLES_RESET;
+    return output->isReady();
 }
 
 /**
  * @brief Fill the whole strip with the given color.
+ * The white LEDs of a strip with white are turned off.
  *
  * @param color
  */
 void WS2812::fill(const RgbColor& color)
 {
-    assert(numLedsPerPixel == 3);
+    fill(WrgbColor(0, color.r, color.g, color.b));
+}
+
+/**
+ * @brief Fill the whole strip with the given color.
+ * The white value is ignored, if the strip has no white LEDs.
+ *
+ * @param color
+ */
+void WS2812::fill(const WrgbColor& color)
+{
+    uint8_t *pixel = pixels.data();
+    uint8_t *end = pixel + pixels.size();
 
-    for (int i = 0; i < numPixels * numLedsPerPixel; i += numLedsPerPixel)
+    for (; pixel != end; pixel += numLedsPerPixel)
     {
-        pixels.at(i + offR) = color.r;
-        pixels.at(i + offG) = color.g;
-        pixels.at(i + offB) = color.b;
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+        if (numLedsPerPixel == 4)
+        {
+            pixel[3] = color.w;
+        }
     }
+    dirtyEnd = numPixels;
 }
 
 /**
  * @brief Set the color to the nth-Pixel
+ * The white LED of a strip with white is turned off.
  *
  * @param num (index) of the pixel whose color you want to change.
  * The first pixel has index 0, last pixel has numPixels - 1.
@@ -164,23 +339,74 @@ void WS2812::fill(const RgbColor& color)
  */
 void WS2812::setPixelColor(uint16_t num, const RgbColor& color)
 {
-    assert(numLedsPerPixel == 3);
+    setPixelColor(num, WrgbColor(0, color.r, color.g, color.b));
+}
+
+/**
+ * @brief Set the color to the nth-Pixel
+ * The white value is ignored, if the strip has no white LEDs.
+ *
+ * @param num (index) of the pixel whose color you want to change.
+ * The first pixel has index 0, last pixel has numPixels - 1.
+ * @param color a wrgb-color
+ */
+void WS2812::setPixelColor(uint16_t num, const WrgbColor& color)
+{
     if (num >= numPixels)
         return;
 
-    uint32_t pixIdx = num * numLedsPerPixel;
+    uint8_t *pixel = pixels.data() + num * numLedsPerPixel;
+
+    pixel[0] = color.r;
+    pixel[1] = color.g;
+    pixel[2] = color.b;
+    if (numLedsPerPixel == 4)
+    {
+        pixel[3] = color.w;
+    }
+    markDirty(num);
+}
 
-    pixels.at(pixIdx + offR) = color.r;
-    pixels.at(pixIdx + offG) = color.g;
-    pixels.at(pixIdx + offB) = color.b;
+/**
+ * @brief Direct access to the pixels, getPixelBufferSize() bytes in R, G, B (, W) order
+ * (see stripHasWhite()). The whole strip is marked as modified.
+ *
+ * @return pointer to the color of the first pixel
+ */
+uint8_t *WS2812::getPixelBuffer()
+{
+    dirtyEnd = numPixels;
+    return pixels.data();
 }
 
 /**
  * @brief Set a brightness value between 0 and 255. To new value is applied to
- * all pixels.
+ * all pixels with the next present().
  * @param brightness
  */
 void WS2812::setBrightness(uint8_t brightness)
 {
-    this->brightness = brightness;
+    lut.setBrightness(brightness);
+}
+
+/**
+ * @brief Enable or disable the gamma correction (2.8), disabled by default.
+ * @param enabled
+ */
+void WS2812::setGammaCorrection(bool enabled)
+{
+    lut.setGammaCorrection(enabled);
+}
+
+/**
+ * @brief Set the white balance calibration. Each channel is scaled by value / 255.
+ */
+void WS2812::setWhiteBalance(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    lut.setWhiteBalance(r, g, b, w);
+}
+
+bool WS2812::stripHasWhite() const
+{
+    return numLedsPerPixel == 4;
 }
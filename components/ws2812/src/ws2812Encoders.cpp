@@ -0,0 +1,85 @@
+#include "ws2812Encoders.hpp"
+
+namespace ws2812encoder {
+
+/**
+ * I2S patterns for the 4 bits of a nibble (MSB first).
+ */
+static const uint16_t i2sNibble[16] = {
+    0x8888, 0x888e, 0x88e8, 0x88ee, 0x8e88, 0x8e8e, 0x8ee8, 0x8eee,
+    0xe888, 0xe88e, 0xe8e8, 0xe8ee, 0xee88, 0xee8e, 0xeee8, 0xeeee,
+};
+
+/**
+ * UART characters for 2 WS2812 bits. The index is the first bit * 2 + the second bit.
+ * The line is inverted: the start bit is the high part of the first bit, the stop
+ * bit the low part of the second bit.
+ */
+static const uint8_t uartPair[4] = {
+    0b110111,   // 0 0
+    0b000111,   // 0 1
+    0b110100,   // 1 0
+    0b000100,   // 1 1
+};
+
+static inline uint8_t byteAt(const uint32_t *wire, uint32_t index)
+{
+    return wire[index / 4] >> (24 - 8 * (index % 4));
+}
+
+size_t encodeI2s(const uint32_t *wire, uint32_t bits, uint32_t *out)
+{
+    size_t words = i2sWords(bits);
+    for (size_t i = 0; i < words; i++)
+    {
+        uint8_t value = byteAt(wire, i);
+        out[i] = (uint32_t)i2sNibble[value >> 4] << 16 | i2sNibble[value & 0x0f];
+    }
+    return words;
+}
+
+size_t encodeUart(const uint32_t *wire, uint32_t bits, uint8_t *out)
+{
+    size_t bytes = bits / 8;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        uint8_t value = byteAt(wire, i);
+        *out++ = uartPair[value >> 6];
+        *out++ = uartPair[value >> 4 & 0b11];
+        *out++ = uartPair[value >> 2 & 0b11];
+        *out++ = uartPair[value & 0b11];
+    }
+    return bytes * 4;
+}
+
+void transposeLanes(const uint32_t *const *lanes, const uint32_t *laneBits, uint8_t laneCount, uint32_t bits, uint8_t *out)
+{
+    for (uint32_t index = 0; index < bits / 8; index++, out += 8)
+    {
+        // byte n of the matrix is the byte of lane n, bit 7 is sent first
+        uint64_t matrix = 0;
+        for (uint8_t lane = 0; lane < laneCount; lane++)
+        {
+            if (lanes[lane] && index < laneBits[lane] / 8)
+            {
+                matrix |= (uint64_t)byteAt(lanes[lane], index) << (8 * lane);
+            }
+        }
+
+        // transpose the 8 x 8 bit matrix, afterwards byte n holds bit n of each lane
+        uint64_t t;
+        t = (matrix ^ (matrix >> 7)) & 0x00aa00aa00aa00aaULL;
+        matrix ^= t ^ (t << 7);
+        t = (matrix ^ (matrix >> 14)) & 0x0000cccc0000ccccULL;
+        matrix ^= t ^ (t << 14);
+        t = (matrix ^ (matrix >> 28)) & 0x00000000f0f0f0f0ULL;
+        matrix ^= t ^ (t << 28);
+
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            out[bit] = matrix >> (8 * (7 - bit));
+        }
+    }
+}
+
+} // namespace ws2812encoder
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include "ws2812Output.hpp"
+
+/*
+ * Minimal benchmark harness for the host build. Each case is repeated
+ * until it ran for at least 50ms, the result is printed as one line
+ * (or one CSV line / JSON object, see benchMain.cpp).
+ */
+namespace bench {
+
+struct Result {
+    const char *suite;
+    const char *name;
+    uint32_t pixels;
+    uint64_t iterations;
+    double nsPerIteration;
+    double allocationsPerIteration;     // calls of operator new
+};
+
+/** Prevent the optimizer from removing a computed value */
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void report(const Result &result);
+
+/** Strip lengths of the strip and effect suites (--pixels) */
+const std::vector<uint16_t> &pixelCounts();
+
+/** Number of operator new calls since the start (benchMain.cpp replaces the global operator new) */
+uint64_t allocationCount();
+
+template <typename Body>
+Result run(const char *suite, const char *name, uint32_t pixels, Body &&body)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto minimum = std::chrono::milliseconds(50);
+
+    for (int i = 0; i < 16; i++)
+    {
+        body();
+    }
+
+    uint64_t iterations = 0;
+    const uint64_t allocations = allocationCount();
+    auto start = Clock::now();
+    Clock::duration elapsed;
+    do
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            body();
+        }
+        iterations += 64;
+        elapsed = Clock::now() - start;
+    } while (elapsed < minimum);
+
+    Result result = {suite, name, pixels, iterations,
+                     (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations,
+                     (double)(allocationCount() - allocations) / iterations};
+    report(result);
+    return result;
+}
+
+/**
+ * @brief Output which discards the frames, so only the CPU work of the strip is measured.
+ */
+class NullOutput : public Ws2812Output {
+public:
+    bool transmit(const uint32_t *wire, uint32_t bits) override { return true; }
+    bool isReady() const override { return true; }
+};
+
+// suites
+void benchPixelLayout();
+void benchEffects();
+void benchController();
+void benchTranspose();
+void benchJson();
+
+} // namespace bench
@@ -0,0 +1,67 @@
+#include <string.h>
+#include "bench.hpp"
+#include "controller.hpp"
+#include "FixedOrderWS2812.hpp"
+
+/*
+ * One frame of each effect through Controller::update() at 50 fps, as the
+ * controllerTask renders it: setEffectPixels(), the brightness and present()
+ * (encoding). The transitions are disabled. A steady SOLID frame is skipped,
+ * so its case changes the color every frame; the STREAM case uploads one
+ * changed byte per frame like a realtime sender. The segments case splits the
+ * strip into four segments with the rainbow effects. ANIMATION needs a file,
+ * its decoder is measured by neopixel_animation.
+ */
+
+static const char *effectNames[EFFECT_COUNT] = {"solid", "rainbow", "rainbow cycle", "stream", "animation"};
+
+namespace bench {
+
+void benchController()
+{
+    for (uint16_t pixels : pixelCounts())
+    {
+        for (uint8_t effect = 0; effect < ANIMATION; effect++)
+        {
+            Controller controller(std::unique_ptr<WS2812>(
+                new FixedOrderWS2812<PixelOrder::GRB>(std::make_unique<NullOutput>(), pixels)));
+            controller.setTransitionDuration(0);
+            controller.setEffectSpeed(1);
+            controller.setEffect((Effect)effect);
+
+            uint8_t frame = 0;
+            run("controller", effectNames[effect], pixels, [&] {
+                frame++;
+                if (effect == SOLID)
+                {
+                    controller.setTargetColor(RgbColor(frame, 255 - frame, 0));
+                }
+                else if (effect == STREAM)
+                {
+                    uint8_t *buffer = controller.acquireStreamBuffer();
+                    if (buffer)
+                    {
+                        buffer[frame % controller.getStreamBufferSize()] = frame;
+                        controller.releaseStreamBuffer(true);
+                    }
+                }
+                controller.update(20000);
+            });
+        }
+
+        Controller controller(std::unique_ptr<WS2812>(
+            new FixedOrderWS2812<PixelOrder::GRB>(std::make_unique<NullOutput>(), pixels)));
+        controller.setTransitionDuration(0);
+        SegmentLayout layout = {};
+        const uint16_t length = pixels / 4 ? pixels / 4 : 1;
+        for (uint16_t start = 0; start + length <= pixels && layout.count < 4; start += length, layout.count++)
+        {
+            Effect effect = layout.count % 2 ? RAINBOW : RAINBOW_CYCLE;
+            layout.segments[layout.count] = Segment{start, length, effect, RgbColor(), 50, 128};
+        }
+        controller.setSegments(layout);
+        run("controller", "4 segments", pixels, [&] { controller.update(20000); });
+    }
+}
+
+} // namespace bench
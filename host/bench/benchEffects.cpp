@@ -0,0 +1,69 @@
+#include "bench.hpp"
+#include "FixedOrderWS2812.hpp"
+#include "hueWheel.hpp"
+
+/*
+ * Rendering of the RAINBOW_CYCLE frame. The sequential walk is the previous
+ * implementation (each pixel is derived from its predecessor), kept here as
+ * the reference for the closed-form hue wheel.
+ */
+
+static void sequentialStep(uint8_t *colorMask, int8_t *sign, RgbColor *target, uint8_t offset)
+{
+    uint8_t *colorPtr = reinterpret_cast<uint8_t *>(target);
+    int16_t newVal = (colorPtr[*colorMask] + *sign * offset);
+    uint8_t nextColorMask = (*colorMask + 2) % 3;
+
+    if (newVal < 0) {
+        colorPtr[*colorMask] = 0;
+        colorPtr[nextColorMask] -= newVal;
+    } else if (newVal > 255) {
+        colorPtr[*colorMask] = 255;
+        colorPtr[nextColorMask] -= newVal % 255;
+    } else {
+        colorPtr[*colorMask] = newVal;
+    }
+
+    if (colorPtr[*colorMask] == 0 || colorPtr[*colorMask] == 255) {
+        *colorMask = (*colorMask + 2) % 3;
+        *sign = -*sign;
+    }
+}
+
+namespace bench {
+
+void benchEffects()
+{
+    for (uint16_t pixels : pixelCounts())
+    {
+        FixedOrderWS2812<PixelOrder::GRB> strip(std::make_unique<NullOutput>(), pixels);
+
+        uint8_t phase = 1;
+        int8_t sign = 1;
+        RgbColor first(255, 0, 0);
+        run("rainbowCycle", "sequential walk", pixels, [&] {
+            sequentialStep(&phase, &sign, &first, 1);
+            strip.setPixelColor(0, first);
+            uint8_t nextPhase = phase;
+            int8_t nextSign = sign;
+            RgbColor next = first;
+            for (uint16_t i = 1; i < pixels; i++)
+            {
+                sequentialStep(&nextPhase, &nextSign, &next, 100);
+                strip.setPixelColor(i, next);
+            }
+        });
+
+        uint16_t hue = 0;
+        run("rainbowCycle", "hue wheel", pixels, [&] {
+            hue += 43;
+            uint16_t pixelHue = hue;
+            for (uint16_t i = 0; i < pixels; i++, pixelHue += 4283)
+            {
+                strip.setPixelColor(i, hueToRgb(pixelHue));
+            }
+        });
+    }
+}
+
+} // namespace bench
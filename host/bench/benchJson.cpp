@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.hpp"
+#include "requestParser.hpp"
+#ifdef BENCH_WITH_CJSON
+#include "cJSON.h"
+#endif
+
+/*
+ * Parsing of the POST /color body. The pixels column is the body length in bytes.
+ * With -DCJSON_DIR=<sdk>/components/json/cJSON the previous cJSON path of the
+ * color handler (parse, parse again for the fields, delete) is measured as well.
+ */
+
+static const char *bodies[][2] = {
+    {"brightness", "{\"brightness\": 128}"},
+    {"all fields", "{\"effect\": 2, \"effectSpeed\": 10, \"color\": [255, 128, 0], \"brightness\": 200, "
+                   "\"transitionMs\": 500, \"rainbowSpeed\": 43, \"rainbowSpread\": 4283}"},
+    {"unknown fields", "{\"name\": \"living room\", \"tags\": [\"a\", {\"b\": [1, 2, 3]}], \"color\": [1, 2, 3]}"},
+};
+
+#ifdef BENCH_WITH_CJSON
+static bool parseCjson(const char *body, request_data &data)
+{
+    cJSON *check = cJSON_Parse(body);
+    if (check == NULL)
+    {
+        return false;
+    }
+    cJSON *json = cJSON_Parse(body);
+    cJSON *item;
+    if ((item = cJSON_GetObjectItem(json, "effect")) != NULL && cJSON_IsNumber(item))
+        data.effect = (Effect)item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "effectSpeed")) != NULL && cJSON_IsNumber(item))
+        data.effectSpeed = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "brightness")) != NULL && cJSON_IsNumber(item))
+        data.brightness = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "transitionMs")) != NULL && cJSON_IsNumber(item))
+        data.transitionMs = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "rainbowSpeed")) != NULL && cJSON_IsNumber(item))
+        data.rainbowSpeed = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "rainbowSpread")) != NULL && cJSON_IsNumber(item))
+        data.rainbowSpread = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "color")) != NULL && cJSON_IsArray(item) && cJSON_GetArraySize(item) == 3)
+        data.color = RgbColor(cJSON_GetArrayItem(item, 0)->valueint, cJSON_GetArrayItem(item, 1)->valueint,
+                              cJSON_GetArrayItem(item, 2)->valueint);
+    cJSON_Delete(json);
+    cJSON_Delete(check);
+    return true;
+}
+#endif
+
+namespace bench {
+
+void benchJson()
+{
+    for (auto &body : bodies)
+    {
+        const char *name = body[0];
+        const char *text = body[1];
+        const size_t length = strlen(text);
+        char caseName[64];
+
+        RequestParser parser;
+        snprintf(caseName, sizeof(caseName), "whole %s", name);
+        run("json", caseName, length, [&] {
+            parser.reset();
+            parser.feed(text, length);
+            doNotOptimize(parser.finish());
+        });
+
+        // like the color handler, which receives the body in 64 byte chunks
+        snprintf(caseName, sizeof(caseName), "chunked %s", name);
+        run("json", caseName, length, [&] {
+            parser.reset();
+            for (size_t offset = 0; offset < length; offset += 64)
+            {
+                parser.feed(text + offset, length - offset < 64 ? length - offset : 64);
+            }
+            doNotOptimize(parser.finish());
+        });
+
+#ifdef BENCH_WITH_CJSON
+        snprintf(caseName, sizeof(caseName), "cJSON %s", name);
+        run("json", caseName, length, [&] {
+            request_data data = default_request_data();
+            doNotOptimize(parseCjson(text, data));
+        });
+#endif
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include "bench.hpp"
+
+/*
+ *   neopixel_bench [--format table|csv|json] [--pixels 10,100,300,1000,2000] [--suite name]
+ *
+ * The table is meant to be read, csv and json to be stored per release and compared.
+ * json is a single object: {"compiler": ..., "optimized": ..., "results": [{"suite": ..., "case": ..., ...}]}
+ */
+
+static std::atomic<uint64_t> allocations(0);
+
+// counts the allocations of the measured code, the sim RTOS does not allocate after the setup
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t size) noexcept
+{
+    free(memory);
+}
+
+enum Format {
+    FORMAT_TABLE,
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
+static Format format = FORMAT_TABLE;
+static const char *suite = nullptr;
+static uint32_t resultCount = 0;
+
+namespace bench {
+
+static std::vector<uint16_t> pixels = {10, 100, 300, 1000, 2000};
+
+const std::vector<uint16_t> &pixelCounts()
+{
+    return pixels;
+}
+
+uint64_t allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void report(const Result &result)
+{
+    const double nsPerPixel = result.pixels ? result.nsPerIteration / result.pixels : 0.0;
+    switch (format)
+    {
+        case FORMAT_TABLE:
+            printf("%-14s %-28s %6u %12.1f %10.2f %8.2f\n", result.suite, result.name, result.pixels,
+                   result.nsPerIteration, nsPerPixel, result.allocationsPerIteration);
+            break;
+        case FORMAT_CSV:
+            printf("%s,\"%s\",%u,%llu,%.1f,%.3f,%.3f\n", result.suite, result.name, result.pixels,
+                   (unsigned long long)result.iterations, result.nsPerIteration, nsPerPixel, result.allocationsPerIteration);
+            break;
+        case FORMAT_JSON:
+            printf("%s\n  {\"suite\": \"%s\", \"case\": \"%s\", \"pixels\": %u, \"iterations\": %llu, "
+                   "\"nsPerIteration\": %.1f, \"nsPerPixel\": %.3f, \"allocationsPerIteration\": %.3f}",
+                   resultCount ? "," : "", result.suite, result.name, result.pixels, (unsigned long long)result.iterations,
+                   result.nsPerIteration, nsPerPixel, result.allocationsPerIteration);
+            break;
+    }
+    resultCount++;
+    fflush(stdout);
+}
+
+} // namespace bench
+
+static bool parsePixels(const char *list)
+{
+    bench::pixels.clear();
+    for (const char *p = list; *p;)
+    {
+        char *end;
+        unsigned long count = strtoul(p, &end, 10);
+        if (end == p || count == 0 || count > 65535 || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        bench::pixels.push_back(count);
+        p = *end ? end + 1 : end;
+    }
+    return !bench::pixels.empty();
+}
+
+static bool enabled(const char *name)
+{
+    return suite == nullptr || !strcmp(suite, name);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--format") && hasValue)
+        {
+            const char *value = argv[++i];
+            format = !strcmp(value, "csv") ? FORMAT_CSV : !strcmp(value, "json") ? FORMAT_JSON : FORMAT_TABLE;
+        }
+        else if (!strcmp(argv[i], "--pixels") && hasValue && parsePixels(argv[i + 1]))
+        {
+            i++;
+        }
+        else if (!strcmp(argv[i], "--suite") && hasValue)
+        {
+            suite = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--format table|csv|json] [--pixels 10,100,300,1000,2000] "
+                            "[--suite layout|effects|controller|transpose|json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    switch (format)
+    {
+        case FORMAT_TABLE:
+            printf("%-14s %-28s %6s %12s %10s %8s\n", "suite", "case", "pixels", "ns/iter", "ns/pixel", "allocs");
+            break;
+        case FORMAT_CSV:
+            printf("suite,case,pixels,iterations,ns_per_iteration,ns_per_pixel,allocations_per_iteration\n");
+            break;
+        case FORMAT_JSON:
+#ifdef __OPTIMIZE__
+            printf("{\"compiler\": \"%s\", \"optimized\": true, \"results\": [", __VERSION__);
+#else
+            printf("{\"compiler\": \"%s\", \"optimized\": false, \"results\": [", __VERSION__);
+#endif
+            break;
+    }
+
+    if (enabled("layout"))
+    {
+        bench::benchPixelLayout();
+    }
+    if (enabled("effects"))
+    {
+        bench::benchEffects();
+    }
+    if (enabled("controller"))
+    {
+        bench::benchController();
+    }
+    if (enabled("transpose"))
+    {
+        bench::benchTranspose();
+    }
+    if (enabled("json"))
+    {
+        bench::benchJson();
+    }
+
+    if (format == FORMAT_JSON)
+    {
+        printf("\n]}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "bench.hpp"
+#include "FixedOrderWS2812.hpp"
+
+/*
+ * Compares the encoder of WS2812 with the runtime decoded offsets with the
+ * encoder of FixedOrderWS2812 with the compile time offsets.
+ */
+
+template <PixelOrder::PixelOrder Order>
+static void compare(const char *runtimeName, const char *fixedName, uint16_t pixels)
+{
+    WS2812 runtime(std::make_unique<bench::NullOutput>(), pixels, Order);
+    FixedOrderWS2812<Order> fixed(std::make_unique<bench::NullOutput>(), pixels);
+    WrgbColor color(10, 20, 30, 40);
+
+    // present() skips clean frames, the last pixel is written so the whole frame is encoded
+    bench::run("encode", runtimeName, pixels, [&] {
+        runtime.setPixelColor(pixels - 1, color);
+        runtime.present();
+    });
+    bench::run("encode", fixedName, pixels, [&] {
+        fixed.setPixelColor(pixels - 1, color);
+        fixed.present();
+    });
+}
+
+namespace bench {
+
+void benchPixelLayout()
+{
+    for (uint16_t pixels : pixelCounts())
+    {
+        compare<PixelOrder::GRB>("WS2812 GRB", "FixedOrderWS2812<GRB>", pixels);
+        compare<PixelOrder::GRBW>("WS2812 GRBW", "FixedOrderWS2812<GRBW>", pixels);
+    }
+}
+
+} // namespace bench
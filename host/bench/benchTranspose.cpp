@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <vector>
+#include "bench.hpp"
+#include "ws2812Encoders.hpp"
+
+/*
+ * Transposition of the lanes of a ParallelBitBang group. The bitwise loop is
+ * the straightforward reference for the 8 x 8 block transpose of transposeLanes().
+ * The pixels column is the length of each lane.
+ */
+
+static void transposeBitwise(const uint32_t *const *lanes, const uint32_t *laneBits, uint8_t laneCount, uint32_t bits, uint8_t *out)
+{
+    for (uint32_t bit = 0; bit < bits; bit++)
+    {
+        uint8_t value = 0;
+        for (uint8_t lane = 0; lane < laneCount; lane++)
+        {
+            if (bit < laneBits[lane] && (lanes[lane][bit / 32] >> (31 - bit % 32)) & 1)
+            {
+                value |= 1 << lane;
+            }
+        }
+        out[bit] = value;
+    }
+}
+
+namespace bench {
+
+void benchTranspose()
+{
+    for (uint16_t pixels : pixelCounts())
+    {
+        for (uint8_t laneCount : {4, 8})
+        {
+            const uint32_t bits = pixels * 24;
+            std::vector<uint32_t> wires[ws2812encoder::MAX_LANES];
+            const uint32_t *lanes[ws2812encoder::MAX_LANES];
+            uint32_t laneBits[ws2812encoder::MAX_LANES];
+            for (uint8_t lane = 0; lane < laneCount; lane++)
+            {
+                wires[lane].resize((bits + 31) / 32);
+                for (uint32_t &word : wires[lane])
+                {
+                    word = (uint32_t)rand() << 16 ^ rand();
+                }
+                lanes[lane] = wires[lane].data();
+                laneBits[lane] = bits;
+            }
+            std::vector<uint8_t> out(bits);
+
+            const char *bitwise = laneCount == 4 ? "bitwise 4 lanes" : "bitwise 8 lanes";
+            run("transpose", bitwise, pixels, [&] {
+                transposeBitwise(lanes, laneBits, laneCount, bits, out.data());
+                doNotOptimize(out[0]);
+            });
+            const char *block = laneCount == 4 ? "8x8 blocks 4 lanes" : "8x8 blocks 8 lanes";
+            run("transpose", block, pixels, [&] {
+                ws2812encoder::transposeLanes(lanes, laneBits, laneCount, bits, out.data());
+                doNotOptimize(out[0]);
+            });
+        }
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "requestParser.hpp"
+#ifdef BENCH_WITH_CJSON
+#include "cJSON.h"
+#endif
+
+/*
+ * Mutation fuzzer for the RequestParser. Every input of the corpus directory and
+ * its mutations are parsed at once and in random chunks, both results must be equal.
+ * With -DCJSON_DIR=<sdk>/components/json/cJSON the results are compared to cJSON:
+ * if both accept a body, the fields must be equal.
+ *
+ *   neopixel_json_fuzz <corpus directory> [mutations per input] [seed]
+ *
+ * Returns 0 if no input failed. Build with -DCMAKE_CXX_FLAGS=-fsanitize=address,undefined
+ * to check the memory accesses as well.
+ */
+
+struct Result {
+    bool accepted;
+    std::string error;
+    request_data data;
+};
+
+static uint64_t randomState;
+
+static uint32_t random32()
+{
+    // xorshift64*, deterministic for a seed
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (randomState * 2685821657736338717ull) >> 32;
+}
+
+static Result parse(const std::string &body, bool chunked)
+{
+    RequestParser parser;
+    size_t offset = 0;
+    while (offset < body.size())
+    {
+        size_t length = chunked ? 1 + random32() % 16 : body.size();
+        length = length < body.size() - offset ? length : body.size() - offset;
+        if (!parser.feed(body.data() + offset, length))
+        {
+            break;
+        }
+        offset += length;
+    }
+
+    Result result = {parser.finish(), "", parser.getData()};
+    if (!result.accepted)
+    {
+        const request_error &error = parser.getError();
+        result.error = std::string(error.field) + ": " + error.message + " @" + std::to_string(error.offset);
+    }
+    return result;
+}
+
+static bool sameData(const request_data &a, const request_data &b)
+{
+    return a.color == b.color && a.brightness == b.brightness && a.effect == b.effect &&
+           a.effectSpeed == b.effectSpeed && a.rainbowSpeed == b.rainbowSpeed &&
+           a.rainbowSpread == b.rainbowSpread && a.transitionMs == b.transitionMs;
+}
+
+#ifdef BENCH_WITH_CJSON
+/**
+ * @brief Reference result of cJSON with the rules of the parser (the last of equal keys
+ * wins, only integers in range), nullopt if cJSON or the rules reject the body. cJSON
+ * stops at a null character, such bodies are not compared.
+ */
+static std::optional<request_data> parseCjson(const std::string &body)
+{
+    if (body.find('\0') != std::string::npos)
+    {
+        return std::nullopt;
+    }
+    const char *end;
+    cJSON *json = cJSON_ParseWithOpts(body.c_str(), &end, true);
+    if (json == NULL)
+    {
+        return std::nullopt;
+    }
+
+    request_data data = default_request_data();
+    bool valid = cJSON_IsObject(json);
+    auto integer = [&](cJSON *item, int max) {
+        valid &= cJSON_IsNumber(item) && item->valuedouble == (double)item->valueint && item->valueint >= 0 && item->valueint <= max;
+        return item->valueint;
+    };
+    for (cJSON *item = valid ? json->child : NULL; item != NULL; item = item->next)
+    {
+        const char *key = item->string;
+        if (!strcmp(key, "effect")) data.effect = (Effect)integer(item, ANIMATION);
+        else if (!strcmp(key, "effectSpeed")) data.effectSpeed = integer(item, 255);
+        else if (!strcmp(key, "brightness")) data.brightness = integer(item, 255);
+        else if (!strcmp(key, "transitionMs")) data.transitionMs = integer(item, 65535);
+        else if (!strcmp(key, "rainbowSpeed")) data.rainbowSpeed = integer(item, 65535);
+        else if (!strcmp(key, "rainbowSpread")) data.rainbowSpread = integer(item, 65535);
+        else if (!strcmp(key, "color"))
+        {
+            valid &= cJSON_IsArray(item) && cJSON_GetArraySize(item) == 3;
+            if (valid)
+            {
+                uint8_t r = integer(cJSON_GetArrayItem(item, 0), 255);
+                uint8_t g = integer(cJSON_GetArrayItem(item, 1), 255);
+                uint8_t b = integer(cJSON_GetArrayItem(item, 2), 255);
+                data.color = RgbColor(r, g, b);
+            }
+        }
+    }
+    cJSON_Delete(json);
+    return valid ? std::optional<request_data>(data) : std::nullopt;
+}
+#endif
+
+static void mutate(std::string &body)
+{
+    static const char tokens[] = "{}[],:\"\\ -0123456789.eEtrufalsn";
+    switch (random32() % 5)
+    {
+        case 0: // replace a byte
+            if (!body.empty())
+                body[random32() % body.size()] = random32() % 2 ? tokens[random32() % (sizeof(tokens) - 1)] : (char)random32();
+            break;
+        case 1: // insert a byte
+            body.insert(body.begin() + random32() % (body.size() + 1), tokens[random32() % (sizeof(tokens) - 1)]);
+            break;
+        case 2: // delete a byte
+            if (!body.empty())
+                body.erase(random32() % body.size(), 1);
+            break;
+        case 3: // truncate
+            body.resize(random32() % (body.size() + 1));
+            break;
+        case 4: // duplicate a part
+            if (!body.empty())
+            {
+                size_t start = random32() % body.size();
+                body.insert(random32() % body.size(), body.substr(start, random32() % 16));
+            }
+            break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <corpus directory> [mutations per input] [seed]\n", argv[0]);
+        return 1;
+    }
+    const uint32_t mutations = argc > 2 ? atoi(argv[2]) : 10000;
+    randomState = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+    randomState |= 1;
+
+    std::vector<std::pair<std::string, std::string>> corpus;
+    DIR *dir = opendir(argv[1]);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
+    for (struct dirent *entry; (entry = readdir(dir)) != NULL;)
+    {
+        std::string path = std::string(argv[1]) + "/" + entry->d_name;
+        FILE *file = entry->d_name[0] != '.' ? fopen(path.c_str(), "rb") : NULL;
+        if (file == NULL)
+        {
+            continue;
+        }
+        std::string body;
+        char buffer[256];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            body.append(buffer, read);
+        }
+        fclose(file);
+        corpus.emplace_back(entry->d_name, body);
+    }
+    closedir(dir);
+    std::sort(corpus.begin(), corpus.end());
+
+    uint64_t inputs = 0, accepted = 0, failures = 0, compared = 0, onlyParser = 0, onlyCjson = 0;
+    for (const auto &[name, seed] : corpus)
+    {
+        Result result = parse(seed, false);
+        printf("%-24s %s\n", name.c_str(), result.accepted ? "accepted" : result.error.c_str());
+
+        for (uint32_t i = 0; i <= mutations; i++)
+        {
+            std::string body = seed;
+            for (uint32_t n = i ? 1 + random32() % 4 : 0; n > 0; n--)
+            {
+                mutate(body);
+            }
+
+            Result whole = parse(body, false);
+            Result chunked = parse(body, true);
+            inputs++;
+            accepted += whole.accepted;
+            if (whole.accepted != chunked.accepted || whole.error != chunked.error || !sameData(whole.data, chunked.data))
+            {
+                failures++;
+                printf("FAILED chunked parse differs: '%s' (%s / %s)\n", body.c_str(), whole.error.c_str(), chunked.error.c_str());
+                continue;
+            }
+
+#ifdef BENCH_WITH_CJSON
+            std::optional<request_data> reference = parseCjson(body);
+            if (whole.accepted && reference.has_value())
+            {
+                compared++;
+                if (!sameData(whole.data, reference.value()))
+                {
+                    failures++;
+                    printf("FAILED cJSON differs: '%s'\n", body.c_str());
+                }
+            }
+            else if (whole.accepted)
+            {
+                // skipped values are not validated by the parser
+                onlyParser++;
+            }
+            else if (reference.has_value())
+            {
+                // cJSON accepts integral fractions and exponents, e.g. 1.0 or 1e2
+                onlyCjson++;
+            }
+#endif
+        }
+    }
+
+    printf("inputs: %llu, accepted: %llu, compared with cJSON: %llu (only parser: %llu, only cJSON: %llu), failures: %llu\n",
+           (unsigned long long)inputs, (unsigned long long)accepted, (unsigned long long)compared,
+           (unsigned long long)onlyParser, (unsigned long long)onlyCjson, (unsigned long long)failures);
+    return failures ? 2 : 0;
+}
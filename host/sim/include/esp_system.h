@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+/** The heap is not simulated, both return 0 */
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
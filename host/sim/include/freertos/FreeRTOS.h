@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * Host stand-in for the FreeRTOS headers of the ESP8266_RTOS_SDK.
+ * Only the parts used by the project are provided. Time is taken
+ * from the simulated clock (see simClock.hpp).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+
+#ifndef configTICK_RATE_HZ
+#define configTICK_RATE_HZ 100
+#endif
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+
+uint32_t xthal_get_ccount(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+// The lwIP socket API of the SDK follows the BSD sockets, the host uses its own.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
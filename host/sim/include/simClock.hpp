@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Simulated CPU clock and GPIO of the ESP8266.
+ *
+ * The clock is deterministic: it only advances when the ccount register is
+ * read (cyclesPerRead cycles per read, which models the busy waiting loops)
+ * or when a task delays. As on the target, the ccount register is reset by
+ * the tick interrupt. The tick interrupt is deferred while a critical
+ * section is active, so ccount keeps counting during a transmission.
+ */
+namespace sim {
+
+/** CPU frequency of the simulated device in Hz */
+uint32_t cpuFrequency();
+
+/** Total number of cycles since the last reset() */
+uint64_t now();
+
+/** Advance the clock by the given number of cycles */
+void advance(uint64_t cycles);
+
+/** Cycles consumed by each read of the ccount register (default 1) */
+void setCyclesPerRead(uint32_t cycles);
+
+/**
+ * @brief Simulate an interrupt (e.g. of the WiFi) every interval cycles, whose handler
+ * takes the given cycles. Like the tick interrupt it is pending during a critical section.
+ * An interval of 0 disables it.
+ */
+void setInterrupts(uint32_t interval, uint32_t cycles);
+
+/** True while a critical section is active */
+bool inCritical();
+
+/** Reset the clock, the tick counter and all GPIO levels */
+void reset();
+
+/**
+ * @brief Receives every level change of a GPIO pin.
+ */
+class PinListener {
+public:
+    virtual ~PinListener() = default;
+    virtual void onEdge(uint64_t cycle, bool level) = 0;
+};
+
+void attachPin(uint8_t pin, PinListener *listener);
+void detachPin(uint8_t pin);
+bool pinLevel(uint8_t pin);
+bool pinIsOutput(uint8_t pin);
+
+} // namespace sim
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "ws2812Output.hpp"
+
+namespace sim {
+
+/**
+ * @brief Replays the bitstream of a peripheral encoder on a simulated GPIO pin.
+ *
+ * The I2S and UART outputs can not run on the host, but their encoders can.
+ * These outputs encode the frame with the same pure functions and drive the
+ * pin with the resulting peripheral bitstream at 3.2 MHz, so a VirtualStrip
+ * can decode and verify it.
+ */
+class ReplayOutput : public Ws2812Output {
+public:
+    ReplayOutput(gpio_num_t pin);
+    ~ReplayOutput() override;
+    bool isReady() const override;
+
+protected:
+    /** Drive the pin with the given level for one peripheral bit */
+    void replayBit(bool level);
+    void finish();
+
+private:
+    const gpio_num_t pin;
+    const uint32_t cyclesPerBit;
+    RtosTimestamp lastShow;
+};
+
+class I2sReplayOutput : public ReplayOutput {
+public:
+    using ReplayOutput::ReplayOutput;
+    bool transmit(const uint32_t *wire, uint32_t bits) override;
+
+private:
+    std::vector<uint32_t> buffer;
+};
+
+class UartReplayOutput : public ReplayOutput {
+public:
+    using ReplayOutput::ReplayOutput;
+    bool transmit(const uint32_t *wire, uint32_t bits) override;
+
+private:
+    std::vector<uint8_t> buffer;
+};
+
+} // namespace sim
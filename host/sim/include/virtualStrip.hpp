@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "simClock.hpp"
+
+namespace sim {
+
+/**
+ * @brief High time and period of a single transmitted bit in cycles.
+ * The period of the last bit of a frame is 0, as it ends with the latch.
+ */
+struct BitTiming {
+    uint32_t high;
+    uint32_t period;
+};
+
+/**
+ * @brief A frame latched by the virtual strip.
+ */
+struct Frame {
+    uint64_t startCycle;
+    uint64_t endCycle;
+    std::vector<uint8_t> bytes;
+    std::vector<BitTiming> bits;    // only filled if bit timings are recorded
+};
+
+/**
+ * @brief Timing statistics over all received bits.
+ */
+struct TimingStats {
+    uint64_t bits = 0;
+    uint32_t minHigh0 = UINT32_MAX, maxHigh0 = 0;
+    uint32_t minHigh1 = UINT32_MAX, maxHigh1 = 0;
+    uint32_t minPeriod = UINT32_MAX, maxPeriod = 0;
+    uint64_t violations = 0;        // bits outside of the WS2812B datasheet tolerances
+    uint64_t gaps = 0;              // bits delayed beyond the period tolerance, but not until the reset
+    uint32_t maxGap = 0;            // longest delay beyond the period
+};
+
+/**
+ * @brief Virtual WS2812 strip connected to a simulated GPIO pin.
+ *
+ * The strip decodes the level changes of the pin into bits. A bit is a one,
+ * if the high time is longer than the middle between T0H (0.4us) and T1H (0.8us).
+ * If the line stays low longer than the reset time (50us), the received bytes
+ * are latched as a frame. A shorter delay of a bit (e.g. by an interrupt between
+ * two pixels) is counted as a gap, not as a timing violation.
+ */
+class VirtualStrip : public PinListener {
+public:
+    VirtualStrip(uint8_t pin, bool recordBitTimings = true);
+    ~VirtualStrip() override;
+
+    void onEdge(uint64_t cycle, bool level) override;
+
+    /** All latched frames. A pending frame is latched if the reset time has passed. */
+    const std::vector<Frame> &frames();
+    const TimingStats &stats() const { return timingStats; }
+    void clearFrames();
+
+private:
+    const uint8_t pin;
+    const bool recordBitTimings;
+    const uint32_t resetCycles;
+    const uint32_t threshold;
+    const uint32_t t0h, t1h, period, highTolerance, periodTolerance;
+
+    std::vector<Frame> latched;
+    TimingStats timingStats;
+    Frame current;
+    uint8_t currentByte;
+    uint8_t bitsInByte;
+    bool receiving;
+    uint64_t lastRise;
+    uint64_t lastFall;
+    uint32_t lastHigh;
+
+    void latchPending();
+    void checkTiming(uint32_t high, uint32_t period);
+};
+
+} // namespace sim
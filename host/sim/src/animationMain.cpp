@@ -0,0 +1,354 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "animationFormat.hpp"
+#include "animationPlayer.hpp"
+#include "hueWheel.hpp"
+
+/*
+ * Pre-renders an animation into the format of the AnimationPlayer (see
+ * animationFormat.hpp) and verifies the file by playing it back twice with the
+ * player, the second time through the loop to the first frame. Prints the size,
+ * the frame types and the decode time per frame. Returns 0 if the playback matched.
+ *
+ * The frames are a built-in pattern or raw frames (R, G, B (, W) per pixel) of --input.
+ * Copy the file into build/spiffs_data before the SPIFFS image is generated, it must
+ * not be gzipped like the files of data/:
+ *
+ *   neopixel_animation --pattern chase --rle build/spiffs_data/animation.npa
+ */
+
+using namespace animation;
+
+struct Options {
+    const char *pattern = "plasma";
+    const char *input = nullptr;
+    const char *output = nullptr;
+    uint16_t pixels = CONFIG_ESP_WS2812_NUM_LED;
+    uint8_t channels = 3;
+    uint8_t fps = 30;
+    uint32_t frames = 300;
+    uint16_t keyframeInterval = 0;      // 0: one keyframe per second
+    bool rle = false;
+};
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--pattern plasma|fire|chase] [--input FILE] [--pixels N] [--white] [--fps N] [--frames N] [--keyframes N] [--rle] OUTPUT\n",
+            name);
+    exit(1);
+}
+
+static Options parseOptions(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--pattern") && hasValue)
+        {
+            options.pattern = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--input") && hasValue)
+        {
+            options.input = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--pixels") && hasValue)
+        {
+            options.pixels = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--white"))
+        {
+            options.channels = 4;
+        }
+        else if (!strcmp(argv[i], "--fps") && hasValue)
+        {
+            options.fps = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--frames") && hasValue)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--keyframes") && hasValue)
+        {
+            options.keyframeInterval = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--rle"))
+        {
+            options.rle = true;
+        }
+        else if (argv[i][0] != '-' && !options.output)
+        {
+            options.output = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (!options.output || !options.pixels || !options.fps)
+    {
+        usage(argv[0]);
+    }
+    if (!options.keyframeInterval)
+    {
+        options.keyframeInterval = options.fps;
+    }
+    return options;
+}
+
+/**
+ * @brief Render the frames of a built-in pattern.
+ * @return false if the pattern is unknown
+ */
+static bool renderPattern(const Options &options, std::vector<std::vector<uint8_t>> &frames)
+{
+    const uint16_t pixels = options.pixels;
+    const uint8_t channels = options.channels;
+    std::vector<uint8_t> heat(pixels);
+    srand(1);
+
+    for (uint32_t t = 0; t < options.frames; t++)
+    {
+        std::vector<uint8_t> frame(pixels * channels);
+        if (!strcmp(options.pattern, "plasma"))
+        {
+            // every pixel changes in every frame
+            for (uint16_t i = 0; i < pixels; i++)
+            {
+                double value = sin(i * 0.21 + t * 0.07) + sin(i * 0.05 - t * 0.045);
+                RgbColor color = hueToRgb((uint16_t)((value + 2) * 16383));
+                frame[i * channels] = color.r;
+                frame[i * channels + 1] = color.g;
+                frame[i * channels + 2] = color.b;
+            }
+        }
+        else if (!strcmp(options.pattern, "fire"))
+        {
+            // the heat cools down, rises and is ignited at the bottom of the strip
+            for (uint16_t i = 0; i < pixels; i++)
+            {
+                uint8_t cooling = rand() % (550 / pixels + 2);
+                heat[i] = heat[i] > cooling ? heat[i] - cooling : 0;
+            }
+            for (uint16_t i = pixels - 1; i >= 2; i--)
+            {
+                heat[i] = (heat[i - 1] + 2 * heat[i - 2]) / 3;
+            }
+            if (rand() % 3 == 0)
+            {
+                uint16_t spark = rand() % (pixels < 7 ? pixels : 7);
+                uint16_t value = heat[spark] + 160 + rand() % 96;
+                heat[spark] = value > 255 ? 255 : value;
+            }
+            for (uint16_t i = 0; i < pixels; i++)
+            {
+                uint8_t level = heat[i] * 3;
+                frame[i * channels] = heat[i] >= 85 ? 255 : level;
+                frame[i * channels + 1] = heat[i] >= 170 ? 255 : heat[i] >= 85 ? level : 0;
+                frame[i * channels + 2] = heat[i] >= 170 ? level : 0;
+            }
+        }
+        else if (!strcmp(options.pattern, "chase"))
+        {
+            // three dots with fading tails on a dark strip
+            for (uint8_t dot = 0; dot < 3; dot++)
+            {
+                uint16_t head = (t + dot * pixels / 3) % pixels;
+                RgbColor color = hueToRgb(dot * 21845);
+                for (uint8_t tail = 0; tail < 4 && tail <= head; tail++)
+                {
+                    uint8_t *pixel = &frame[(head - tail) * channels];
+                    pixel[0] = color.r >> tail;
+                    pixel[1] = color.g >> tail;
+                    pixel[2] = color.b >> tail;
+                }
+            }
+        }
+        else
+        {
+            return false;
+        }
+        frames.push_back(std::move(frame));
+    }
+    return true;
+}
+
+static bool readFrames(const Options &options, std::vector<std::vector<uint8_t>> &frames)
+{
+    FILE *file = fopen(options.input, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<uint8_t> frame(options.pixels * options.channels);
+    while (fread(frame.data(), 1, frame.size(), file) == frame.size())
+    {
+        frames.push_back(frame);
+    }
+    fclose(file);
+    return !frames.empty();
+}
+
+/**
+ * @brief Append the ops of one frame. Without a previous frame (keyframe) all pixels are
+ * encoded, otherwise the unchanged pixels are skipped and the ops end after the last
+ * changed pixel. With rle runs of 3 or more equal pixels are encoded once.
+ */
+static void encodeOps(const uint8_t *previous, const uint8_t *frame, uint16_t pixels, uint8_t channels,
+                      bool rle, std::vector<uint8_t> &out)
+{
+    auto changed = [&](uint16_t i) {
+        return !previous || memcmp(previous + i * channels, frame + i * channels, channels) != 0;
+    };
+    auto runLength = [&](uint16_t i) {
+        uint16_t length = 1;
+        while (i + length < pixels && length < MAX_OP_PIXELS &&
+               !memcmp(frame + i * channels, frame + (i + length) * channels, channels))
+        {
+            length++;
+        }
+        return length;
+    };
+
+    uint16_t end = pixels;
+    while (previous && end > 0 && !changed(end - 1))
+    {
+        end--;
+    }
+
+    uint16_t i = 0;
+    while (i < end)
+    {
+        uint16_t count = 0;
+        if (!changed(i))
+        {
+            while (i + count < end && count < MAX_OP_PIXELS && !changed(i + count))
+            {
+                count++;
+            }
+            out.push_back(OP_SKIP | (count - 1));
+        }
+        else if (rle && (count = runLength(i)) >= 3)
+        {
+            out.push_back(OP_RUN | (count - 1));
+            out.insert(out.end(), frame + i * channels, frame + (i + 1) * channels);
+        }
+        else
+        {
+            count = 0;
+            while (i + count < end && count < MAX_OP_PIXELS && changed(i + count) && !(rle && runLength(i + count) >= 3))
+            {
+                count++;
+            }
+            out.push_back(OP_LITERAL | (count - 1));
+            out.insert(out.end(), frame + i * channels, frame + (i + count) * channels);
+        }
+        i += count;
+    }
+}
+
+static void appendFrame(FrameType type, const std::vector<uint8_t> &ops, std::vector<uint8_t> &out)
+{
+    out.push_back(type);
+    out.push_back(ops.size());
+    out.push_back(ops.size() >> 8);
+    out.push_back(ops.size() >> 16);
+    out.insert(out.end(), ops.begin(), ops.end());
+}
+
+int main(int argc, char **argv)
+{
+    Options options = parseOptions(argc, argv);
+    std::vector<std::vector<uint8_t>> frames;
+    if (options.input ? !readFrames(options, frames) : !renderPattern(options, frames))
+    {
+        fprintf(stderr, "no frames from %s\n", options.input ? options.input : options.pattern);
+        return 1;
+    }
+
+    Header header = {options.pixels, options.channels, options.fps, (uint32_t)frames.size(),
+                     options.keyframeInterval, (uint16_t)(options.rle ? FLAG_RLE : 0)};
+    std::vector<uint8_t> file(HEADER_SIZE);
+    writeHeader(header, file.data());
+
+    // a delta frame is only used if it is smaller than the keyframe
+    uint32_t keyframes = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        std::vector<uint8_t> key, delta;
+        encodeOps(nullptr, frames[i].data(), options.pixels, options.channels, options.rle, key);
+        if (i % options.keyframeInterval)
+        {
+            encodeOps(frames[i - 1].data(), frames[i].data(), options.pixels, options.channels, options.rle, delta);
+        }
+        if (i % options.keyframeInterval == 0 || key.size() <= delta.size())
+        {
+            appendFrame(FRAME_KEY, key, file);
+            keyframes++;
+        }
+        else
+        {
+            appendFrame(FRAME_DELTA, delta, file);
+        }
+    }
+
+    FILE *out = fopen(options.output, "wb");
+    if (!out || fwrite(file.data(), 1, file.size(), out) != file.size() || fclose(out) != 0)
+    {
+        fprintf(stderr, "can not write %s\n", options.output);
+        return 1;
+    }
+    const size_t raw = frames.size() * options.pixels * options.channels;
+    printf("frames:                 %zu (%u keyframes, %zu delta frames)\n", frames.size(), keyframes,
+           frames.size() - keyframes);
+    printf("file bytes:             %zu (raw %zu, %.1f%%)\n", file.size(), raw, 100.0 * file.size() / raw);
+    printf("bytes per second:       %zu at %u fps\n", file.size() * options.fps / frames.size(), options.fps);
+
+    // play two loops and compare every frame
+    AnimationPlayer player;
+    if (!player.open(options.output, 1))
+    {
+        return 2;
+    }
+    std::vector<uint8_t> pixels(options.pixels * options.channels);
+    bool matches = true;
+    uint64_t decodeNs = 0;
+    uint64_t maxDecodeNs = 0;
+    for (size_t i = 0; i < frames.size() * 2; i++)
+    {
+        // after an underrun the frame is decoded by the next call
+        bool decoded;
+        uint64_t ns;
+        do
+        {
+            auto start = std::chrono::steady_clock::now();
+            decoded = player.decode(1, pixels.data());
+            ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            if (!decoded)
+            {
+                std::this_thread::yield();
+            }
+        } while (!decoded && !player.hasFailed());
+        decodeNs += ns;
+        maxDecodeNs = ns > maxDecodeNs ? ns : maxDecodeNs;
+        if (!decoded || pixels != frames[i % frames.size()])
+        {
+            fprintf(stderr, "frame %zu does not match\n", i);
+            matches = false;
+            break;
+        }
+    }
+    const AnimationStats &stats = player.getStats();
+    printf("host decode ns (avg/max): %llu / %llu\n", (unsigned long long)(decodeNs / (frames.size() * 2)),
+           (unsigned long long)maxDecodeNs);
+    printf("bytes read:             %llu (%u underruns, %u loops)\n", (unsigned long long)stats.bytesRead,
+           stats.underruns, stats.loops);
+    printf("playback:               %s\n", matches ? "ok" : "FAILED");
+    return matches ? 0 : 2;
+}
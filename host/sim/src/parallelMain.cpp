@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "simClock.hpp"
+#include "virtualStrip.hpp"
+#include "FixedOrderWS2812.hpp"
+#include "ws2812Encoders.hpp"
+
+/*
+ * Drives strips of different lengths with one ParallelBitBang group and checks the
+ * frames and the bit timings on the virtual strips of all pins, the transmission
+ * time against sequential BitBangOutputs and the transposition against a bitwise
+ * reference. Returns 0 if all checks passed.
+ *
+ *   neopixel_parallel [lanes (1 - 8)] [frames]
+ */
+
+static const gpio_num_t PINS[ParallelBitBang::MAX_LANES] = {
+    GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_12, GPIO_NUM_13, GPIO_NUM_14, GPIO_NUM_15, GPIO_NUM_0, GPIO_NUM_2,
+};
+static const uint16_t PIXELS[ParallelBitBang::MAX_LANES] = {60, 100, 150, 150, 30, 120, 90, 10};
+
+static int failures = 0;
+
+static void check(const char *name, bool passed)
+{
+    printf("%-56s %s\n", name, passed ? "ok" : "FAILED");
+    failures += !passed;
+}
+
+/** Bitwise reference of ws2812encoder::transposeLanes() */
+static bool transposeMatches(uint8_t laneCount)
+{
+    std::vector<uint32_t> wires[ParallelBitBang::MAX_LANES];
+    const uint32_t *lanes[ParallelBitBang::MAX_LANES];
+    uint32_t bits[ParallelBitBang::MAX_LANES];
+    uint32_t maxBits = 0;
+    for (uint8_t lane = 0; lane < laneCount; lane++)
+    {
+        bits[lane] = PIXELS[lane] * 24;
+        wires[lane].resize((bits[lane] + 31) / 32);
+        for (uint32_t &word : wires[lane])
+        {
+            word = (uint32_t)rand() << 16 ^ rand();
+        }
+        lanes[lane] = wires[lane].data();
+        maxBits = bits[lane] > maxBits ? bits[lane] : maxBits;
+    }
+
+    std::vector<uint8_t> out(maxBits);
+    ws2812encoder::transposeLanes(lanes, bits, laneCount, maxBits, out.data());
+    for (uint32_t bit = 0; bit < maxBits; bit++)
+    {
+        uint8_t expected = 0;
+        for (uint8_t lane = 0; lane < laneCount; lane++)
+        {
+            if (bit < bits[lane] && (wires[lane][bit / 32] >> (31 - bit % 32)) & 1)
+            {
+                expected |= 1 << lane;
+            }
+        }
+        if (out[bit] != expected)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const int lanes = argc > 1 ? atoi(argv[1]) : 4;
+    const int frames = argc > 2 ? atoi(argv[2]) : 10;
+    if (lanes < 1 || lanes > ParallelBitBang::MAX_LANES || frames < 1)
+    {
+        fprintf(stderr, "usage: %s [lanes (1 - %d)] [frames]\n", argv[0], ParallelBitBang::MAX_LANES);
+        return 1;
+    }
+
+    sim::reset();
+    std::vector<std::unique_ptr<sim::VirtualStrip>> virtualStrips;
+    std::vector<std::unique_ptr<FixedOrderWS2812<PixelOrder::GRB>>> strips;
+    ParallelBitBang group(PINS, lanes);
+    uint32_t longest = 0, sequentialCycles = 0;
+    for (uint8_t lane = 0; lane < lanes; lane++)
+    {
+        virtualStrips.push_back(std::make_unique<sim::VirtualStrip>(PINS[lane]));
+        strips.push_back(std::make_unique<FixedOrderWS2812<PixelOrder::GRB>>(group.createOutput(lane), PIXELS[lane]));
+        strips.back()->setGammaCorrection(false);
+        longest = PIXELS[lane] > longest ? PIXELS[lane] : longest;
+        sequentialCycles += PIXELS[lane] * 24 * CYCLES_800;
+    }
+
+    check("transposition matches the bitwise reference", transposeMatches(lanes));
+    // the outputs are ready after the reset time
+    vTaskDelay(1);
+
+    // full frames with random colors on all lanes
+    std::vector<std::vector<uint8_t>> expected(lanes);
+    bool framesMatch = true;
+    uint32_t maxTransmitCycles = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (uint8_t lane = 0; lane < lanes; lane++)
+        {
+            expected[lane].clear();
+            for (uint16_t i = 0; i < PIXELS[lane]; i++)
+            {
+                RgbColor color(rand(), rand(), rand());
+                strips[lane]->setPixelColor(i, color);
+                expected[lane].insert(expected[lane].end(), {color.g, color.r, color.b});
+            }
+            framesMatch &= strips[lane]->show();
+        }
+        framesMatch &= group.transmit();
+        maxTransmitCycles = group.getTransmitCycles() > maxTransmitCycles ? group.getTransmitCycles() : maxTransmitCycles;
+        vTaskDelay(1);
+
+        for (uint8_t lane = 0; lane < lanes; lane++)
+        {
+            const std::vector<sim::Frame> &received = virtualStrips[lane]->frames();
+            framesMatch &= received.size() == (size_t)frame + 1 && received.back().bytes == expected[lane];
+        }
+    }
+    check("every lane receives its frames", framesMatch);
+
+    bool timing = true;
+    for (uint8_t lane = 0; lane < lanes; lane++)
+    {
+        timing &= virtualStrips[lane]->stats().violations == 0;
+    }
+    check("no timing violations on any pin", timing);
+
+    const uint32_t wireCycles = longest * 24 * CYCLES_800;
+    printf("transmit cycles: %u (longest lane %u, sequential %u)\n", maxTransmitCycles, wireCycles, sequentialCycles);
+    check("lanes are sent in the time of the longest lane", maxTransmitCycles < wireCycles + wireCycles / 50);
+
+    // only the first pixel of lane 0 changes: a short prefix on lane 0, the other pins stay low
+    strips[0]->setPixelColor(0, RgbColor(1, 2, 3));
+    check("a changed prefix is handed to its lane", strips[0]->show());
+    check("the group sends the pending lanes", group.transmit());
+    vTaskDelay(1);
+    const std::vector<sim::Frame> &first = virtualStrips[0]->frames();
+    check("lane 0 receives only the changed pixel",
+          first.size() == (size_t)frames + 1 && first.back().bytes == std::vector<uint8_t>({2, 1, 3}));
+    bool idle = true;
+    for (uint8_t lane = 1; lane < lanes; lane++)
+    {
+        idle &= virtualStrips[lane]->frames().size() == (size_t)frames;
+    }
+    check("lanes without a frame stay idle", idle);
+    check("nothing is sent without a pending frame", !group.transmit());
+
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,267 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <mutex>
+#include "simClock.hpp"
+#include "ws2812Hal.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define F_CPU (CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ * 1000000)
+#define CYCLES_PER_TICK (F_CPU / configTICK_RATE_HZ)
+
+namespace {
+
+struct State {
+    uint64_t cycles = 0;
+    uint64_t lastTick = 0;      // cycle of the last tick interrupt, ccount is relative to it
+    uint32_t ticks = 0;
+    uint32_t cyclesPerRead = 1;
+    uint32_t criticalDepth = 0;
+    uint32_t interruptInterval = 0;     // cycles between the simulated interrupts, 0 without
+    uint32_t interruptCycles = 0;       // duration of one interrupt handler
+    uint64_t nextInterrupt = 0;
+    uint32_t levels = 0;
+    uint32_t outputs = 0;
+    sim::PinListener *listeners[GPIO_NUM_MAX] = {};
+};
+
+State state;
+// Held by every access to the simulated CPU and for the whole duration of a
+// critical section, so no other task (thread) runs while interrupts are disabled.
+std::recursive_mutex cpuLock;
+esp_log_level_t logLevel = ESP_LOG_WARN;
+
+/**
+ * The tick interrupt resets ccount. While a critical section is active
+ * the interrupt is pending, and fires (once) when the section is left.
+ * The same holds for the simulated interrupts, which take the cycles of their handler.
+ */
+void processTicks()
+{
+    if (state.criticalDepth > 0)
+    {
+        return;
+    }
+    if (state.interruptInterval && state.cycles >= state.nextInterrupt)
+    {
+        state.cycles += state.interruptCycles;
+        state.nextInterrupt = state.cycles + state.interruptInterval;
+    }
+    while (state.cycles - state.lastTick >= CYCLES_PER_TICK)
+    {
+        state.ticks++;
+        state.lastTick += CYCLES_PER_TICK;
+    }
+}
+
+void writePins(uint32_t pinMask, bool level)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    for (uint8_t pin = 0; pin < GPIO_NUM_MAX; pin++)
+    {
+        uint32_t bit = 1UL << pin;
+        if (!(pinMask & bit) || ((state.levels & bit) != 0) == level)
+        {
+            continue;
+        }
+        state.levels ^= bit;
+        if (state.listeners[pin] && (state.outputs & bit))
+        {
+            state.listeners[pin]->onEdge(state.cycles, level);
+        }
+    }
+}
+
+} // namespace
+
+namespace sim {
+
+uint32_t cpuFrequency()
+{
+    return F_CPU;
+}
+
+uint64_t now()
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    return state.cycles;
+}
+
+void advance(uint64_t cycles)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    state.cycles += cycles;
+    processTicks();
+}
+
+void setCyclesPerRead(uint32_t cycles)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    state.cyclesPerRead = cycles;
+}
+
+bool inCritical()
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    return state.criticalDepth > 0;
+}
+
+void setInterrupts(uint32_t interval, uint32_t cycles)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    state.interruptInterval = interval;
+    state.interruptCycles = cycles;
+    state.nextInterrupt = state.cycles + interval;
+}
+
+void reset()
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    State fresh;
+    for (uint8_t pin = 0; pin < GPIO_NUM_MAX; pin++)
+    {
+        fresh.listeners[pin] = state.listeners[pin];
+    }
+    fresh.interruptInterval = state.interruptInterval;
+    fresh.interruptCycles = state.interruptCycles;
+    fresh.nextInterrupt = state.interruptInterval;
+    state = fresh;
+}
+
+void attachPin(uint8_t pin, PinListener *listener)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    state.listeners[pin] = listener;
+}
+
+void detachPin(uint8_t pin)
+{
+    attachPin(pin, nullptr);
+}
+
+bool pinLevel(uint8_t pin)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    return state.levels & (1UL << pin);
+}
+
+bool pinIsOutput(uint8_t pin)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    return state.outputs & (1UL << pin);
+}
+
+} // namespace sim
+
+namespace ws2812hal {
+
+uint32_t cycleCount()
+{
+    return xthal_get_ccount();
+}
+
+void pinSet(uint32_t pinMask)
+{
+    writePins(pinMask, true);
+}
+
+void pinClear(uint32_t pinMask)
+{
+    writePins(pinMask, false);
+}
+
+void enterCritical()
+{
+    vPortEnterCritical();
+}
+
+void exitCritical()
+{
+    vPortExitCritical();
+}
+
+} // namespace ws2812hal
+
+uint32_t xthal_get_ccount(void)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    state.cycles += state.cyclesPerRead;
+    processTicks();
+    return (uint32_t)(state.cycles - state.lastTick);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    return state.ticks;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    // the delay ends with the tick interrupt
+    uint64_t nextTick = state.lastTick + CYCLES_PER_TICK;
+    state.cycles = nextTick + (uint64_t)(ticks > 0 ? ticks - 1 : 0) * CYCLES_PER_TICK;
+    processTicks();
+}
+
+void vPortEnterCritical(void)
+{
+    cpuLock.lock();
+    state.criticalDepth++;
+}
+
+void vPortExitCritical(void)
+{
+    if (--state.criticalDepth == 0)
+    {
+        if (state.cycles - state.lastTick >= CYCLES_PER_TICK)
+        {
+            // the pending tick interrupt fires once and resets ccount
+            state.ticks++;
+            state.lastTick = state.cycles;
+        }
+        processTicks();
+    }
+    cpuLock.unlock();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)(sim::now() / (F_CPU / 1000000));
+}
+
+esp_err_t gpio_config(const gpio_config_t *gpio_cfg)
+{
+    std::lock_guard<std::recursive_mutex> lock(cpuLock);
+    if (gpio_cfg->mode == GPIO_MODE_OUTPUT || gpio_cfg->mode == GPIO_MODE_OUTPUT_OD)
+    {
+        state.outputs |= gpio_cfg->pin_bit_mask;
+    }
+    else
+    {
+        state.outputs &= ~gpio_cfg->pin_bit_mask;
+    }
+    return ESP_OK;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    logLevel = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char levelChar[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    if (level > logLevel)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%lld) %s: ", levelChar[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "simClock.hpp"
+#include "virtualStrip.hpp"
+#include "controller.hpp"
+#include "frameScheduler.hpp"
+#include "metrics.hpp"
+#include "FixedOrderWS2812.hpp"
+#include "simOutputs.hpp"
+
+/*
+ * Runs the controller against the virtual strip, the same way the
+ * controllerTask does on the target (see FrameScheduler), and reports the
+ * render and transmit costs as well as the recorded frames and bit timings.
+ *
+ * With the STREAM effect a moving dot is uploaded into the stream buffer
+ * before each frame, like the /frame endpoint does. The ANIMATION effect plays
+ * the file of --animation (written by neopixel_animation).
+ *
+ * By default the presented frames are transmitted after each frame on the
+ * same thread, which keeps the simulation deterministic. With --pipeline
+ * a second thread transmits like the transmitTask on the target.
+ *
+ * --interrupts simulates an interrupt every INTERVAL us whose handler takes
+ * HANDLER us, --interruptible enables the interrupts between the pixels of the
+ * bit-bang output (see BitBangOutput::setInterruptible()).
+ */
+
+struct Options {
+    uint16_t pixels = CONFIG_ESP_WS2812_NUM_LED;
+    uint32_t frames = 100;
+    uint16_t fps = CONFIG_ESP_WS2812_TARGET_FPS;
+    Effect effect = SOLID;
+    int switchEffect = -1;              // effect which is set after half of the frames
+    RgbColor color = RgbColor(255, 128, 0);
+    bool recordBitTimings = true;
+    bool dump = false;
+    bool pipeline = false;
+    const char *output = "bitbang";
+    const char *metrics = nullptr;      // print the metrics in this format (prometheus or json)
+    const char *animation = nullptr;    // file of the ANIMATION effect
+    uint32_t interruptIntervalUs = 0;
+    uint32_t interruptHandlerUs = 0;
+    int maxGapUs = -1;                  // interruptible bit-bang output with this maximum gap
+};
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--pixels N] [--frames N] [--fps N] [--effect N] [--switch-effect N] [--color R,G,B] [--output bitbang|i2s|uart] [--pipeline] [--no-bit-timings] [--dump] [--metrics prometheus|json] [--animation FILE] [--interrupts INTERVAL,HANDLER] [--interruptible MAX_GAP_US]\n",
+            name);
+    exit(1);
+}
+
+static Options parseOptions(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--pixels") && hasValue)
+        {
+            options.pixels = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--frames") && hasValue)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--fps") && hasValue)
+        {
+            options.fps = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--effect") && hasValue)
+        {
+            options.effect = (Effect)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--switch-effect") && hasValue)
+        {
+            options.switchEffect = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--color") && hasValue)
+        {
+            int r, g, b;
+            if (sscanf(argv[++i], "%d,%d,%d", &r, &g, &b) != 3)
+            {
+                usage(argv[0]);
+            }
+            options.color = RgbColor(r, g, b);
+        }
+        else if (!strcmp(argv[i], "--output") && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--pipeline"))
+        {
+            options.pipeline = true;
+        }
+        else if (!strcmp(argv[i], "--no-bit-timings"))
+        {
+            options.recordBitTimings = false;
+        }
+        else if (!strcmp(argv[i], "--dump"))
+        {
+            options.dump = true;
+        }
+        else if (!strcmp(argv[i], "--metrics") && hasValue)
+        {
+            options.metrics = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--animation") && hasValue)
+        {
+            options.animation = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--interrupts") && hasValue)
+        {
+            if (sscanf(argv[++i], "%u,%u", &options.interruptIntervalUs, &options.interruptHandlerUs) != 2)
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(argv[i], "--interruptible") && hasValue)
+        {
+            options.maxGapUs = atoi(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char **argv)
+{
+    Options options = parseOptions(argc, argv);
+    const gpio_num_t pin = (gpio_num_t)CONFIG_ESP_WS2812_PIN;
+
+    const uint32_t cyclesPerUs = sim::cpuFrequency() / 1000000;
+    sim::setInterrupts(options.interruptIntervalUs * cyclesPerUs, options.interruptHandlerUs * cyclesPerUs);
+    sim::reset();
+    sim::VirtualStrip strip(pin, options.recordBitTimings);
+    std::unique_ptr<Ws2812Output> output;
+    if (!strcmp(options.output, "i2s"))
+    {
+        output = std::make_unique<sim::I2sReplayOutput>(pin);
+    }
+    else if (!strcmp(options.output, "uart"))
+    {
+        output = std::make_unique<sim::UartReplayOutput>(pin);
+    }
+    else
+    {
+        auto bitBang = std::make_unique<BitBangOutput>(pin);
+        if (options.maxGapUs >= 0)
+        {
+            bitBang->setInterruptible(PixelLayout<PixelOrder::GRB>::channels * 8, options.maxGapUs);
+        }
+        output = std::move(bitBang);
+    }
+    std::unique_ptr<WS2812> ledPtr(new FixedOrderWS2812<PixelOrder::GRB>(std::move(output), options.pixels));
+    WS2812 *led = ledPtr.get();
+    Controller controller(std::move(ledPtr));
+    controller.setTargetColor(options.color);
+    controller.setEffect(options.effect);
+    AnimationPlayer animation;
+    if (options.animation && (!animation.open(options.animation, 1) || !controller.setAnimation(&animation)))
+    {
+        return 1;
+    }
+    FrameScheduler scheduler(controller, *led, options.fps);
+
+    std::atomic<bool> running(true);
+    std::thread transmitter;
+    if (options.pipeline)
+    {
+        transmitter = std::thread([led, &running] {
+            while (running)
+            {
+                if (led->waitForFrame(1))
+                {
+                    while (running && !led->isReady())
+                    {
+                        std::this_thread::yield();
+                    }
+                    led->transmitPending();
+                }
+            }
+        });
+    }
+
+    uint64_t renderNs = 0;
+    uint64_t startCycle = sim::now();
+    for (uint32_t frame = 0; frame < options.frames; frame++)
+    {
+        if (options.switchEffect >= 0 && frame == options.frames / 2)
+        {
+            controller.post(FIELD_EFFECT, options.switchEffect);
+        }
+        if (controller.getEffect() == STREAM)
+        {
+            uint8_t *buffer = controller.acquireStreamBuffer();
+            if (buffer)
+            {
+                size_t size = controller.getStreamBufferSize();
+                memset(buffer, 0, size);
+                size_t dot = frame % options.pixels * controller.getChannelsPerPixel();
+                buffer[dot] = options.color.r;
+                buffer[dot + 1] = options.color.g;
+                buffer[dot + 2] = options.color.b;
+                controller.releaseStreamBuffer(true);
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        scheduler.runFrame();
+        if (!options.pipeline)
+        {
+            led->transmitPending();
+        }
+        renderNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (controller.getEffect() == ANIMATION && animation.isOpen())
+        {
+            // the reader task runs while the controllerTask waits for the next frame
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+    double simulatedSeconds = (double)(sim::now() - startCycle) / sim::cpuFrequency();
+
+    if (options.pipeline)
+    {
+        running = false;
+        transmitter.join();
+    }
+
+    const auto &frames = strip.frames();
+    const auto &stats = strip.stats();
+    printf("pixels:                 %u\n", options.pixels);
+    const FrameSchedulerStats &schedulerStats = scheduler.getStats();
+    printf("frames scheduled:       %u\n", schedulerStats.frames);
+    printf("simulated fps:          %.1f (target %u)\n", schedulerStats.frames / simulatedSeconds, options.fps);
+    printf("missed deadlines:       %u\n", schedulerStats.missedDeadlines);
+    printf("render us (last/max):   %u / %u\n", schedulerStats.renderUs, schedulerStats.maxRenderUs);
+    printf("transmit us (last/max): %u / %u\n", schedulerStats.transmitUs, schedulerStats.maxTransmitUs);
+    printf("host ns per frame:      %.1f\n", options.frames ? (double)renderNs / options.frames : 0.0);
+    printf("frames latched:         %zu\n", frames.size());
+    printf("bits received:          %llu\n", (unsigned long long)stats.bits);
+    printf("T0H cycles (min/max):   %u / %u\n", stats.minHigh0, stats.maxHigh0);
+    printf("T1H cycles (min/max):   %u / %u\n", stats.minHigh1, stats.maxHigh1);
+    printf("period cycles (min/max):%u / %u\n", stats.minPeriod, stats.maxPeriod);
+    printf("timing violations:      %llu\n", (unsigned long long)stats.violations);
+    printf("gaps (count/max cycles):%llu / %u\n", (unsigned long long)stats.gaps, stats.maxGap);
+
+    const ShowStats &showStats = led->getShowStats();
+    printf("encode cycles:          %u\n", showStats.encodeCycles);
+    printf("transmit cycles:        %u\n", showStats.transmitCycles);
+    printf("transmit overhead:      %d (cycles above the nominal wire time of %u)\n",
+           (int)(showStats.transmitCycles - showStats.wireCycles), showStats.wireCycles);
+
+    const CriticalStats &critical = led->getCriticalStats();
+    printf("interrupts off cycles:  %u (last frame %u)\n", critical.maxCycles, critical.frameMaxCycles);
+    printf("gap overflows:          %u (%u frames sent with interrupts off)\n", critical.gapOverflows, critical.fallbacks);
+
+    const FrameCounters &counters = led->getFrameCounters();
+    printf("frames presented:       %u\n", counters.framesPresented);
+    printf("frames skipped:         %u\n", counters.framesSkipped);
+    printf("frames transmitted:     %u\n", counters.framesTransmitted);
+    printf("bytes saved:            %llu\n", (unsigned long long)counters.bytesSaved);
+
+    if (options.metrics)
+    {
+        // like GET /metrics, without the HTTP handlers
+        Metrics metrics(controller, *led);
+        metrics.setScheduler(&scheduler);
+        if (animation.isOpen())
+        {
+            metrics.setAnimation(&animation);
+        }
+        MetricsWriter writer([](void *context, const char *data, size_t length) {
+            return fwrite(data, 1, length, stdout) == length;
+        }, nullptr);
+        if (!strcmp(options.metrics, "json"))
+        {
+            metrics.writeJson(writer);
+            writer.print("\n");
+        }
+        else
+        {
+            metrics.writePrometheus(writer);
+        }
+        writer.finish();
+    }
+
+    if (options.dump)
+    {
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            printf("frame %zu @%llu:", i, (unsigned long long)frames[i].startCycle);
+            for (uint8_t byte : frames[i].bytes)
+            {
+                printf(" %02x", byte);
+            }
+            printf("\n");
+        }
+    }
+
+    // only the interruptible output may delay a bit
+    return stats.violations == 0 && (options.maxGapUs >= 0 || stats.gaps == 0) ? 0 : 2;
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include "simOutputs.hpp"
+#include "simClock.hpp"
+#include "ws2812.hpp"
+#include "ws2812Encoders.hpp"
+#include "ws2812Hal.hpp"
+
+namespace sim {
+
+ReplayOutput::ReplayOutput(gpio_num_t pin)
+    : pin(pin),
+      cyclesPerBit(cpuFrequency() / ws2812encoder::BIT_CLOCK),
+      lastShow(RtosTimestamp())
+{
+    gpio_config_t io_conf = {};
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pin_bit_mask = 1UL << pin;
+    gpio_config(&io_conf);
+}
+
+ReplayOutput::~ReplayOutput()
+{
+    gpio_config_t io_conf = {};
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = 1UL << pin;
+    gpio_config(&io_conf);
+}
+
+bool ReplayOutput::isReady() const
+{
+    return lastShow.tickDiff() > CYCLES_RESET;
+}
+
+void ReplayOutput::replayBit(bool level)
+{
+    if (level)
+    {
+        ws2812hal::pinSet(1UL << pin);
+    }
+    else
+    {
+        ws2812hal::pinClear(1UL << pin);
+    }
+    advance(cyclesPerBit);
+}
+
+void ReplayOutput::finish()
+{
+    ws2812hal::pinClear(1UL << pin);
+    lastShow.update();
+    notifyDone();
+}
+
+bool I2sReplayOutput::transmit(const uint32_t *wire, uint32_t bits)
+{
+    buffer.resize(ws2812encoder::i2sWords(bits) + ws2812encoder::I2S_RESET_WORDS);
+    size_t words = ws2812encoder::encodeI2s(wire, bits, buffer.data());
+    std::fill(buffer.begin() + words, buffer.end(), 0);
+
+    for (uint32_t word : buffer)
+    {
+        for (int bit = 31; bit >= 0; bit--)
+        {
+            replayBit(word >> bit & 1);
+        }
+    }
+    finish();
+    return true;
+}
+
+bool UartReplayOutput::transmit(const uint32_t *wire, uint32_t bits)
+{
+    buffer.resize(ws2812encoder::uartBytes(bits));
+    ws2812encoder::encodeUart(wire, bits, buffer.data());
+
+    // inverted line: start bit high, data bits inverted (LSB first), stop bit low
+    for (uint8_t character : buffer)
+    {
+        replayBit(true);
+        for (int bit = 0; bit < 6; bit++)
+        {
+            replayBit(!(character >> bit & 1));
+        }
+        replayBit(false);
+    }
+    finish();
+    return true;
+}
+
+} // namespace sim
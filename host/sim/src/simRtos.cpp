@@ -0,0 +1,130 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+
+/*
+ * Tasks are mapped to detached threads, queues to a mutex protected ring buffer
+ * which is allocated by xQueueCreate() like the FreeRTOS queue storage.
+ * Timeouts are waited in real time (one tick = portTICK_PERIOD_MS).
+ */
+
+struct QueueDefinition {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;
+    UBaseType_t first;          // index of the oldest item
+    UBaseType_t count;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+template <typename Predicate>
+static bool waitFor(QueueHandle_t queue, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate predicate)
+{
+    if (ticks == 0)
+    {
+        return predicate();
+    }
+    if (ticks == portMAX_DELAY)
+    {
+        queue->changed.wait(lock, predicate);
+        return true;
+    }
+    return queue->changed.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), predicate);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    auto queue = new QueueDefinition();
+    queue->storage.resize((size_t)length * itemSize);
+    queue->first = 0;
+    queue->count = 0;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue, lock, ticksToWait, [queue] { return queue->count < queue->length; }))
+    {
+        return pdFALSE;
+    }
+    UBaseType_t slot = (queue->first + queue->count) % queue->length;
+    memcpy(&queue->storage[(size_t)slot * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue, lock, ticksToWait, [queue] { return queue->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    memcpy(buffer, &queue->storage[(size_t)queue->first * queue->itemSize], queue->itemSize);
+    queue->first = (queue->first + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->lock);
+    return queue->count;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth,
+                       void *parameter, UBaseType_t priority, TaskHandle_t *handle)
+{
+    std::thread thread(function, parameter);
+    if (handle)
+    {
+        *handle = reinterpret_cast<TaskHandle_t>(thread.native_handle());
+    }
+    thread.detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // tasks are detached threads, they end when their function returns
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return reinterpret_cast<TaskHandle_t>(pthread_self());
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // the stacks of the threads are not tracked
+    return 0;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "lwip/sockets.h"
+#include "simClock.hpp"
+#include "virtualStrip.hpp"
+#include "FixedOrderWS2812.hpp"
+#include "controller.hpp"
+#include "realtimeReceiver.hpp"
+#include "udpListener.hpp"
+
+/*
+ * Sends DDP and E1.31 packets over the loopback interface to the UdpListener
+ * and checks the frames which arrive on the virtual strip as well as the
+ * packet counters. Returns 0 if all checks passed.
+ */
+
+static const uint16_t PIXELS = 200;     // two E1.31 universes
+
+struct Loopback {
+    sim::VirtualStrip strip;
+    FixedOrderWS2812<PixelOrder::GRB> *led;
+    Controller controller;
+    RealtimeReceiver receiver;
+    UdpListener listener;
+    int sender;
+    uint16_t ddpPort;
+    uint16_t e131Port;
+    int failures = 0;
+
+    Loopback(uint16_t ddpPort, uint16_t e131Port) :
+        strip((gpio_num_t)CONFIG_ESP_WS2812_PIN, false),
+        led(new FixedOrderWS2812<PixelOrder::GRB>((gpio_num_t)CONFIG_ESP_WS2812_PIN, PIXELS)),
+        controller(std::unique_ptr<WS2812>(led)),
+        receiver(controller, 1),
+        listener(receiver, ddpPort, e131Port),
+        sender(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)),
+        ddpPort(ddpPort),
+        e131Port(e131Port)
+    {
+        led->setGammaCorrection(false);
+        controller.setTransitionDuration(0);
+    }
+
+    ~Loopback()
+    {
+        close(sender);
+    }
+
+    void send(uint16_t port, const std::vector<uint8_t> &packet)
+    {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        sendto(sender, packet.data(), packet.size(), 0, (struct sockaddr *)&address, sizeof(address));
+    }
+
+    /** Wait until the listener handled the given number of packets in total */
+    void waitFor(uint32_t packets)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            const RealtimeCounters &counters = receiver.getCounters();
+            if (counters.received + counters.late + counters.dropped >= packets)
+            {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /** Render and transmit one frame, return the bytes on the wire or an empty vector if nothing was sent */
+    std::vector<uint8_t> frame()
+    {
+        strip.clearFrames();
+        vTaskDelay(1);
+        controller.update(1000000 / CONFIG_ESP_WS2812_TARGET_FPS);
+        led->transmitPending();
+        vTaskDelay(1);
+        return strip.frames().empty() ? std::vector<uint8_t>() : strip.frames().back().bytes;
+    }
+
+    void check(const char *name, bool passed)
+    {
+        printf("%-48s %s\n", name, passed ? "ok" : "FAILED");
+        failures += !passed;
+    }
+};
+
+static std::vector<uint8_t> ddpPacket(uint8_t sequence, bool push, uint32_t offset, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> packet = {
+        (uint8_t)(0x40 | (push ? 0x01 : 0)), sequence, 0x0b, 1,
+        (uint8_t)(offset >> 24), (uint8_t)(offset >> 16), (uint8_t)(offset >> 8), (uint8_t)offset,
+        (uint8_t)(data.size() >> 8), (uint8_t)data.size()};
+    packet.insert(packet.end(), data.begin(), data.end());
+    return packet;
+}
+
+static void e131Root(std::vector<uint8_t> &packet, uint32_t vector)
+{
+    static const char identifier[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+    packet[1] = 0x10;
+    memcpy(&packet[4], identifier, sizeof(identifier));
+    packet[16] = 0x70 | (packet.size() - 16) >> 8;
+    packet[17] = packet.size() - 16;
+    packet[21] = vector;
+    packet[38] = 0x70 | (packet.size() - 38) >> 8;
+    packet[39] = packet.size() - 38;
+}
+
+static std::vector<uint8_t> e131Packet(uint16_t universe, uint8_t sequence, uint16_t sync, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> packet(126 + data.size());
+    e131Root(packet, 0x04);
+    packet[43] = 0x02;
+    packet[108] = 100;
+    packet[109] = sync >> 8;
+    packet[110] = sync;
+    packet[111] = sequence;
+    packet[113] = universe >> 8;
+    packet[114] = universe;
+    packet[115] = 0x70 | (packet.size() - 115) >> 8;
+    packet[116] = packet.size() - 115;
+    packet[117] = 0x02;
+    packet[118] = 0xa1;
+    packet[122] = 0x01;
+    packet[123] = (data.size() + 1) >> 8;
+    packet[124] = data.size() + 1;
+    memcpy(&packet[126], data.data(), data.size());
+    return packet;
+}
+
+static std::vector<uint8_t> e131Sync(uint8_t sequence, uint16_t sync)
+{
+    std::vector<uint8_t> packet(49);
+    e131Root(packet, 0x08);
+    packet[43] = 0x01;
+    packet[44] = sequence;
+    packet[45] = sync >> 8;
+    packet[46] = sync;
+    return packet;
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t ddpPort = argc > 2 ? atoi(argv[1]) : RealtimeReceiver::DDP_PORT;
+    uint16_t e131Port = argc > 2 ? atoi(argv[2]) : RealtimeReceiver::E131_PORT;
+
+    sim::reset();
+    Loopback loopback(ddpPort, e131Port);
+    if (!loopback.listener.start(5))
+    {
+        fprintf(stderr, "usage: %s [ddpPort e131Port] (the ports must be free)\n", argv[0]);
+        return 1;
+    }
+    uint32_t packets = 0;
+
+    // DDP: pixel 1 red, pushed
+    loopback.send(ddpPort, ddpPacket(1, true, 3, {255, 0, 0}));
+    loopback.waitFor(++packets);
+    std::vector<uint8_t> wire = loopback.frame();
+    loopback.check("DDP push shows the frame", wire.size() >= 6 && wire[3] == 0 && wire[4] == 255 && wire[5] == 0);
+
+    // DDP: data without push is not shown, the next push shows both
+    loopback.send(ddpPort, ddpPacket(2, false, 0, {0, 0, 255}));
+    loopback.waitFor(++packets);
+    loopback.check("DDP without push is not shown", loopback.frame().empty());
+    loopback.send(ddpPort, ddpPacket(3, true, 6, {0, 255, 0}));
+    loopback.waitFor(++packets);
+    wire = loopback.frame();
+    loopback.check("DDP push shows the pending data", wire.size() >= 9 && wire[2] == 255 && wire[6] == 255);
+
+    // DDP: the same and an older sequence number are stale
+    loopback.send(ddpPort, ddpPacket(3, true, 0, {1, 1, 1}));
+    loopback.send(ddpPort, ddpPacket(1, true, 0, {1, 1, 1}));
+    packets += 2;
+    loopback.waitFor(packets);
+    loopback.check("DDP stale sequence numbers are late", loopback.receiver.getCounters().late == 2);
+
+    // E1.31: universe 2 with synchronization address 7, shown with the sync packet
+    std::vector<uint8_t> white(6, 255);
+    loopback.send(e131Port, e131Packet(2, 10, 7, white));
+    loopback.waitFor(++packets);
+    loopback.check("E1.31 synchronized data waits for the sync", loopback.frame().empty());
+    loopback.send(e131Port, e131Sync(1, 7));
+    loopback.waitFor(++packets);
+    wire = loopback.frame();
+    loopback.check("E1.31 sync shows universe 2 at pixel 170", wire.size() >= 172 * 3 && wire[170 * 3] == 255 && wire[171 * 3 + 2] == 255);
+
+    // E1.31: stale sequence of the universe, preview data and a broken packet are not shown
+    loopback.send(e131Port, e131Packet(2, 9, 0, {9, 9, 9}));
+    packets++;
+    std::vector<uint8_t> preview = e131Packet(1, 1, 0, {9, 9, 9});
+    preview[112] = 0x80;
+    loopback.send(e131Port, preview);
+    packets++;
+    loopback.send(e131Port, {1, 2, 3});
+    packets++;
+    loopback.waitFor(packets);
+    loopback.check("E1.31 stale, preview and broken packets are not shown", loopback.frame().empty());
+
+    // E1.31: unsynchronized universe 1 is shown immediately
+    loopback.send(e131Port, e131Packet(1, 200, 0, {0, 0, 128}));
+    loopback.waitFor(++packets);
+    wire = loopback.frame();
+    loopback.check("E1.31 unsynchronized data is shown", wire.size() >= 3 && wire[2] == 128);
+
+    loopback.listener.stop();
+
+    const RealtimeCounters &counters = loopback.receiver.getCounters();
+    printf("received: %u, late: %u, dropped: %u, shown: %u\n", counters.received, counters.late, counters.dropped, counters.shown);
+    loopback.check("counters", counters.received == 6 && counters.late == 3 && counters.dropped == 2 && counters.shown == 4);
+    return loopback.failures ? 2 : 0;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include "virtualStrip.hpp"
+
+namespace sim {
+
+VirtualStrip::VirtualStrip(uint8_t pin, bool recordBitTimings)
+    : pin(pin),
+      recordBitTimings(recordBitTimings),
+      resetCycles(cpuFrequency() / 20000),         // 50us
+      threshold((cpuFrequency() / 2500000 + cpuFrequency() / 1250000) / 2),
+      t0h(cpuFrequency() / 2500000),               // 0.4us
+      t1h(cpuFrequency() / 1250000),               // 0.8us
+      period(cpuFrequency() / 800000),             // 1.25us
+      highTolerance(cpuFrequency() / 6666667),     // 150ns
+      periodTolerance(cpuFrequency() / 1666667),   // 600ns
+      current(),
+      currentByte(0),
+      bitsInByte(0),
+      receiving(false),
+      lastRise(0),
+      lastFall(0),
+      lastHigh(0)
+{
+    attachPin(pin, this);
+}
+
+VirtualStrip::~VirtualStrip()
+{
+    detachPin(pin);
+}
+
+void VirtualStrip::onEdge(uint64_t cycle, bool level)
+{
+    if (level)
+    {
+        if (receiving && cycle - lastFall >= resetCycles)
+        {
+            latchPending();
+        }
+
+        if (receiving)
+        {
+            uint32_t bitPeriod = cycle - lastRise;
+            checkTiming(lastHigh, bitPeriod);
+            if (recordBitTimings)
+            {
+                current.bits.back().period = bitPeriod;
+            }
+        }
+        else
+        {
+            receiving = true;
+            current.startCycle = cycle;
+        }
+        lastRise = cycle;
+        return;
+    }
+
+    if (!receiving)
+    {
+        return;
+    }
+
+    lastHigh = cycle - lastRise;
+    lastFall = cycle;
+    current.endCycle = cycle;
+    if (recordBitTimings)
+    {
+        current.bits.push_back({lastHigh, 0});
+    }
+
+    currentByte = currentByte << 1 | (lastHigh > threshold);
+    if (++bitsInByte == 8)
+    {
+        current.bytes.push_back(currentByte);
+        currentByte = 0;
+        bitsInByte = 0;
+    }
+}
+
+const std::vector<Frame> &VirtualStrip::frames()
+{
+    if (receiving && now() - lastFall >= resetCycles)
+    {
+        latchPending();
+    }
+    return latched;
+}
+
+void VirtualStrip::clearFrames()
+{
+    latched.clear();
+}
+
+void VirtualStrip::latchPending()
+{
+    checkTiming(lastHigh, 0);
+    if (bitsInByte > 0)
+    {
+        // incomplete byte, keep the received bits left aligned
+        current.bytes.push_back(currentByte << (8 - bitsInByte));
+    }
+
+    latched.push_back(std::move(current));
+    current = Frame();
+    currentByte = 0;
+    bitsInByte = 0;
+    receiving = false;
+}
+
+void VirtualStrip::checkTiming(uint32_t high, uint32_t bitPeriod)
+{
+    bool one = high > threshold;
+    uint32_t expected = one ? t1h : t0h;
+    bool violation = high + highTolerance < expected || high > expected + highTolerance;
+
+    timingStats.bits++;
+    if (one)
+    {
+        timingStats.minHigh1 = std::min(timingStats.minHigh1, high);
+        timingStats.maxHigh1 = std::max(timingStats.maxHigh1, high);
+    }
+    else
+    {
+        timingStats.minHigh0 = std::min(timingStats.minHigh0, high);
+        timingStats.maxHigh0 = std::max(timingStats.maxHigh0, high);
+    }
+
+    if (bitPeriod != 0)
+    {
+        timingStats.minPeriod = std::min(timingStats.minPeriod, bitPeriod);
+        timingStats.maxPeriod = std::max(timingStats.maxPeriod, bitPeriod);
+        violation |= bitPeriod + periodTolerance < period;
+        if (bitPeriod > period + periodTolerance)
+        {
+            timingStats.gaps++;
+            timingStats.maxGap = std::max(timingStats.maxGap, bitPeriod - period);
+        }
+    }
+
+    if (violation)
+    {
+        timingStats.violations++;
+    }
+}
+
+} // namespace sim
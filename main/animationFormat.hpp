@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Binary format of the pre-rendered animations (.npa), written by the host
+ * tool neopixel_animation and played by the AnimationPlayer. All values are little endian.
+ *
+ * The file starts with a header of HEADER_SIZE bytes:
+ *   magic "NPA1", u16 pixels, u8 channels (3: R, G, B, 4: R, G, B, W), u8 fps,
+ *   u32 frame count, u16 keyframe interval, u16 flags
+ *
+ * Each frame is a type byte (FRAME_KEY or FRAME_DELTA), the u24 length of its ops
+ * and the ops. An op byte holds the kind in the upper two bits and the number of
+ * pixels - 1 in the lower six bits:
+ *   OP_SKIP     the pixels keep the color of the previous frame (delta frames only)
+ *   OP_LITERAL  the colors of the pixels follow
+ *   OP_RUN      one color follows, which is repeated (FLAG_RLE)
+ * A keyframe covers all pixels, a delta frame ends after its last changed pixel.
+ * The first frame is a keyframe, the animation loops to it after the last frame.
+ */
+namespace animation {
+
+constexpr uint32_t MAGIC = 0x3141504e;          // "NPA1"
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t FRAME_HEADER_SIZE = 4;
+
+enum FrameType : uint8_t {
+    FRAME_KEY = 1,
+    FRAME_DELTA = 2,
+};
+
+enum Op : uint8_t {
+    OP_SKIP = 0x00,
+    OP_LITERAL = 0x40,
+    OP_RUN = 0x80,
+};
+constexpr uint8_t OP_MASK = 0xc0;
+constexpr uint8_t MAX_OP_PIXELS = 64;
+
+enum Flags : uint16_t {
+    FLAG_RLE = 1,                               // the encoder used OP_RUN
+};
+
+struct Header {
+    uint16_t pixels;
+    uint8_t channels;
+    uint8_t fps;
+    uint32_t frames;
+    uint16_t keyframeInterval;
+    uint16_t flags;
+};
+
+inline void writeHeader(const Header &header, uint8_t *out)
+{
+    const uint32_t values[] = {MAGIC, header.pixels, header.channels, header.fps, header.frames,
+                               header.keyframeInterval, header.flags};
+    const uint8_t sizes[] = {4, 2, 1, 1, 4, 2, 2};
+    for (uint8_t i = 0; i < sizeof(sizes); i++)
+    {
+        for (uint8_t byte = 0; byte < sizes[i]; byte++)
+        {
+            *out++ = values[i] >> (8 * byte);
+        }
+    }
+}
+
+/**
+ * @return false if the data is not a valid header
+ */
+inline bool readHeader(const uint8_t *data, Header &header)
+{
+    auto value = [&data](uint8_t size) {
+        uint32_t result = 0;
+        for (uint8_t byte = 0; byte < size; byte++)
+        {
+            result |= (uint32_t)*data++ << (8 * byte);
+        }
+        return result;
+    };
+    const uint32_t magic = value(4);
+    header.pixels = value(2);
+    header.channels = value(1);
+    header.fps = value(1);
+    header.frames = value(4);
+    header.keyframeInterval = value(2);
+    header.flags = value(2);
+    return magic == MAGIC && header.pixels && (header.channels == 3 || header.channels == 4) &&
+           header.fps && header.frames;
+}
+
+} // namespace animation
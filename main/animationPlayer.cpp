@@ -0,0 +1,442 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "animationPlayer.hpp"
+
+using namespace animation;
+
+const char *AnimationPlayer::TAG = "AnimationPlayer";
+
+AnimationPlayer::AnimationPlayer() :
+    file(NULL),
+    header{},
+    stats{},
+    readerPriority(0),
+    chunkLength{},
+    chunkGeneration{},
+    current(NO_CHUNK),
+    position(0),
+    requests(NULL),
+    filled(NULL),
+    running(false),
+    stopped(true),
+    readerTask(NULL),
+    readerGeneration(0),
+    generation(0),
+    rewinding(false),
+    frame(0),
+    pendingFrameTime(0),
+    failed(false)
+{
+}
+
+AnimationPlayer::~AnimationPlayer()
+{
+    close();
+}
+
+/**
+ * @brief Open an animation file and start prefetching its first frames.
+ * @return false if the file can not be read or has no valid header
+ */
+bool AnimationPlayer::open(const char *path, UBaseType_t readerPriority)
+{
+    close();
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        ESP_LOGI(TAG, "No animation at %s", path);
+        return false;
+    }
+
+    uint8_t data[HEADER_SIZE];
+    if (fread(data, 1, sizeof(data), file) != sizeof(data) || !readHeader(data, header))
+    {
+        ESP_LOGE(TAG, "%s is not an animation", path);
+        close();
+        return false;
+    }
+
+    this->readerPriority = readerPriority;
+    chunks[0].resize(CHUNK_SIZE);
+    chunks[1].resize(CHUNK_SIZE);
+    requests = xQueueCreate(3, sizeof(uint8_t));     // both chunks and a rewind
+    filled = xQueueCreate(2, sizeof(uint8_t));
+    if (!requests || !filled || !startReader())
+    {
+        close();
+        return false;
+    }
+    ESP_LOGI(TAG, "%s: %u frames of %u pixels at %u fps", path, header.frames, header.pixels, header.fps);
+    return true;
+}
+
+/**
+ * @brief Stop the reader task and close the file.
+ */
+void AnimationPlayer::close()
+{
+    stopReader();
+    if (requests)
+    {
+        vQueueDelete(requests);
+        requests = NULL;
+    }
+    if (filled)
+    {
+        vQueueDelete(filled);
+        filled = NULL;
+    }
+    if (file)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    chunks[0] = std::vector<uint8_t>();
+    chunks[1] = std::vector<uint8_t>();
+}
+
+/**
+ * @brief Continue with the first frame (a keyframe), e.g. after another effect
+ * changed the pixels. The first frame is due immediately. Does not block, the reader
+ * seeks to the first frame and the chunks it filled before are dropped by nextChunk(),
+ * until then decode() counts underruns.
+ * @return false if no animation is open
+ */
+bool AnimationPlayer::restart()
+{
+    if (!file)
+    {
+        return false;
+    }
+    if (!rewinding)
+    {
+        // without a chunk of the last rewind nothing was decoded since, it is still valid
+        uint8_t rewind = REWIND;
+        xQueueSend(requests, &rewind, 0);
+        generation++;
+        rewinding = true;
+    }
+    if (current != NO_CHUNK)
+    {
+        xQueueSend(requests, &current, 0);
+        current = NO_CHUNK;
+    }
+    position = 0;
+    frame = 0;
+    pendingFrameTime = (uint64_t)1000000;
+    failed = false;
+    return true;
+}
+
+/**
+ * @brief Start prefetching from the first frame.
+ */
+bool AnimationPlayer::startReader()
+{
+    current = NO_CHUNK;
+    position = 0;
+    frame = 0;
+    pendingFrameTime = (uint64_t)1000000;
+    failed = false;
+    readerGeneration = 0;
+    generation = 0;
+    rewinding = false;
+
+    uint8_t chunk;
+    for (chunk = 0; chunk < 2; chunk++)
+    {
+        xQueueSend(requests, &chunk, 0);
+    }
+    running = true;
+    stopped = false;
+    if (xTaskCreate(task, "animationReader", 2048, this, readerPriority, &readerTask) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the reader task");
+        running = false;
+        stopped = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stop the reader task. Blocks until the task ended (up to 100ms), only close() stops it.
+ */
+void AnimationPlayer::stopReader()
+{
+    running = false;
+    while (!stopped)
+    {
+        vTaskDelay(1);
+    }
+}
+
+void AnimationPlayer::task(void *parameter)
+{
+    auto self = static_cast<AnimationPlayer *>(parameter);
+    while (self->running)
+    {
+        uint8_t request;
+        if (xQueueReceive(self->requests, &request, pdMS_TO_TICKS(100)) != pdTRUE)
+        {
+            continue;
+        }
+        if (request == REWIND)
+        {
+            fseek(self->file, HEADER_SIZE, SEEK_SET);
+            self->readerGeneration++;
+        }
+        else
+        {
+            self->fill(request);
+            xQueueSend(self->filled, &request, portMAX_DELAY);
+        }
+    }
+    self->stopped = true;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Read the next CHUNK_SIZE bytes of the frames into a chunk, continue with
+ * the first frame at the end of the file.
+ */
+void AnimationPlayer::fill(uint8_t chunk)
+{
+    int64_t start = esp_timer_get_time();
+    size_t length = 0;
+    bool wrapped = false;
+    while (length < CHUNK_SIZE)
+    {
+        size_t read = fread(chunks[chunk].data() + length, 1, CHUNK_SIZE - length, file);
+        length += read;
+        if (read == 0)
+        {
+            // an empty read right after the wrap: the file has no frames
+            if (wrapped || fseek(file, HEADER_SIZE, SEEK_SET) != 0)
+            {
+                break;
+            }
+            wrapped = true;
+        }
+        else
+        {
+            wrapped = false;
+        }
+    }
+    chunkLength[chunk] = length;
+    chunkGeneration[chunk] = readerGeneration;
+    stats.bytesRead += length;
+    stats.readUs += esp_timer_get_time() - start;
+}
+
+/**
+ * @brief Advance the playback by the elapsed time.
+ * @return the number of frames to decode now (at most MAX_FRAMES_PER_DECODE,
+ * a longer delay slows the animation down instead of decoding a burst)
+ */
+uint32_t AnimationPlayer::framesDue(uint32_t elapsedUs)
+{
+    if (!file || failed)
+    {
+        return 0;
+    }
+    pendingFrameTime += (uint64_t)elapsedUs * header.fps;
+    uint32_t frames = pendingFrameTime / 1000000;
+    pendingFrameTime -= (uint64_t)frames * 1000000;
+    return frames > MAX_FRAMES_PER_DECODE ? MAX_FRAMES_PER_DECODE : frames;
+}
+
+/**
+ * @brief Decode the next frames into the pixels, a delta frame changes only some
+ * of them. The pixels must hold the previous frame, header.pixels * header.channels
+ * bytes in the channel order of the file. A frame which was not read in time yet
+ * (an underrun) is decoded by the next call, the pixels keep the previous frame.
+ *
+ * @return false if no frame was decoded (the file is corrupt or was not read in time)
+ */
+bool AnimationPlayer::decode(uint32_t frames, uint8_t *pixels)
+{
+    bool decoded = false;
+    for (; frames && !failed; frames--)
+    {
+        int64_t start = esp_timer_get_time();
+        if (!decodeFrame(pixels))
+        {
+            break;
+        }
+        decoded = true;
+
+        uint32_t us = esp_timer_get_time() - start;
+        stats.frames++;
+        stats.totalDecodeUs += us;
+        if (us > stats.maxDecodeUs)
+        {
+            stats.maxDecodeUs = us;
+        }
+    }
+    return decoded;
+}
+
+bool AnimationPlayer::decodeFrame(uint8_t *pixels)
+{
+    // a frame is only started if the reader filled its first chunk, a decoded part can not be undone
+    if ((current == NO_CHUNK || position == chunkLength[current]) && !nextChunk(0))
+    {
+        return false;
+    }
+
+    uint8_t frameHeader[FRAME_HEADER_SIZE];
+    if (!read(frameHeader, sizeof(frameHeader)))
+    {
+        return abortFrame();
+    }
+    const uint8_t type = frameHeader[0];
+    const uint32_t length = frameHeader[1] | frameHeader[2] << 8 | (uint32_t)frameHeader[3] << 16;
+    if (type != FRAME_KEY && type != FRAME_DELTA)
+    {
+        ESP_LOGE(TAG, "Invalid type %u of frame %u", type, frame);
+        failed = true;
+        return false;
+    }
+
+    const uint8_t channels = header.channels;
+    uint32_t consumed = 0;
+    uint16_t pixel = 0;
+    while (consumed < length)
+    {
+        uint8_t op;
+        if (!read(&op, 1))
+        {
+            return abortFrame();
+        }
+        const uint8_t count = (op & ~OP_MASK) + 1;
+        const uint8_t kind = op & OP_MASK;
+        if (pixel + count > header.pixels || kind == (OP_LITERAL | OP_RUN) || (kind == OP_SKIP && type == FRAME_KEY))
+        {
+            ESP_LOGE(TAG, "Invalid op 0x%02x at pixel %u of frame %u", op, pixel, frame);
+            failed = true;
+            return false;
+        }
+
+        uint8_t *out = pixels + pixel * channels;
+        switch (kind)
+        {
+        case OP_SKIP:
+            consumed += 1;
+            break;
+        case OP_LITERAL:
+            if (!read(out, count * channels))
+            {
+                return abortFrame();
+            }
+            consumed += 1 + count * channels;
+            break;
+        case OP_RUN:
+            if (!read(out, channels))
+            {
+                return abortFrame();
+            }
+            for (uint8_t i = 1; i < count; i++)
+            {
+                memcpy(out + i * channels, out, channels);
+            }
+            consumed += 1 + channels;
+            break;
+        }
+        pixel += count;
+    }
+    if (consumed != length || (type == FRAME_KEY && pixel != header.pixels))
+    {
+        ESP_LOGE(TAG, "Frame %u does not match its length", frame);
+        failed = true;
+        return false;
+    }
+
+    if (++frame == header.frames)
+    {
+        frame = 0;
+        stats.loops++;
+    }
+    return true;
+}
+
+/**
+ * @brief The reader did not fill a chunk in time within a frame. The partly decoded
+ * frame can not be continued, the playback continues with the first frame (a keyframe).
+ */
+bool AnimationPlayer::abortFrame()
+{
+    if (!failed)
+    {
+        ESP_LOGW(TAG, "Frame %u was not read in time, continuing with the first frame", frame);
+        restart();
+    }
+    return false;
+}
+
+/**
+ * @brief Copy the next bytes of the file, out may be NULL to skip them.
+ * Waits up to 100ms for the next chunk.
+ */
+bool AnimationPlayer::read(uint8_t *out, size_t length)
+{
+    while (length)
+    {
+        if (current == NO_CHUNK || position == chunkLength[current])
+        {
+            if (!nextChunk(pdMS_TO_TICKS(100)))
+            {
+                return false;
+            }
+        }
+        size_t count = chunkLength[current] - position;
+        count = count < length ? count : length;
+        if (out)
+        {
+            memcpy(out, chunks[current].data() + position, count);
+            out += count;
+        }
+        position += count;
+        length -= count;
+    }
+    return true;
+}
+
+/**
+ * @brief Hand the consumed chunk back to the reader and continue with the other one.
+ * A chunk which was filled before the last rewind is handed back as well.
+ *
+ * @return false if no chunk was filled within the wait (an underrun counted in the
+ * stats) or the file has no frames (the playback fails)
+ */
+bool AnimationPlayer::nextChunk(TickType_t wait)
+{
+    if (current != NO_CHUNK)
+    {
+        xQueueSend(requests, &current, 0);
+        current = NO_CHUNK;
+    }
+
+    uint8_t chunk;
+    while (xQueueReceive(filled, &chunk, wait) == pdTRUE)
+    {
+        if (chunkGeneration[chunk] != generation)
+        {
+            xQueueSend(requests, &chunk, 0);
+            continue;
+        }
+        rewinding = false;
+        current = chunk;
+        position = 0;
+        if (chunkLength[chunk] == 0)
+        {
+            ESP_LOGE(TAG, "The animation has no frames");
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+    stats.underruns++;
+    return false;
+}
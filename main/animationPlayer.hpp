@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "animationFormat.hpp"
+
+/**
+ * @brief Decode times of the frames and throughput of the file reads since open().
+ */
+struct AnimationStats {
+    uint32_t frames;            // decoded frames
+    uint32_t maxDecodeUs;
+    uint64_t totalDecodeUs;
+    uint64_t bytesRead;
+    uint64_t readUs;            // time the reader task spent in fread()
+    uint32_t underruns;         // the decoder waited for the next chunk
+    uint32_t loops;             // the animation restarted after its last frame
+};
+
+/**
+ * @brief Plays a pre-rendered animation (see animationFormat.hpp) from a file.
+ * A reader task prefetches the file in two chunks, while the decoder works on
+ * one chunk the other one is filled. The frames are decoded straight into the
+ * pixel buffer of the strip, the player keeps no frame of its own.
+ * The reader wraps to the first frame at the end of the file, so the animation loops.
+ * The reader runs until close(), restart() only asks it to seek, so it does not block.
+ */
+class AnimationPlayer {
+public:
+    static const char *TAG;
+    static constexpr size_t CHUNK_SIZE = 2048;
+
+    AnimationPlayer();
+    ~AnimationPlayer();
+
+    bool open(const char *path, UBaseType_t readerPriority);
+    void close();
+    bool isOpen() const { return file != NULL; }
+    bool hasFailed() const { return failed; }
+    bool restart();
+
+    uint32_t framesDue(uint32_t elapsedUs);
+    bool decode(uint32_t frames, uint8_t *pixels);
+
+    const animation::Header& getHeader() const { return header; }
+    const AnimationStats& getStats() const { return stats; }
+
+private:
+    static constexpr uint8_t NO_CHUNK = 2;
+    static constexpr uint8_t REWIND = 3;        // request to seek to the first frame
+    static constexpr uint32_t MAX_FRAMES_PER_DECODE = 4;
+
+    FILE *file;
+    animation::Header header;
+    AnimationStats stats;
+    UBaseType_t readerPriority;
+
+    // prefetch, the chunk indices are passed between the decoder and the reader task
+    std::vector<uint8_t> chunks[2];
+    size_t chunkLength[2];      // written by the reader before the index is passed back
+    uint8_t chunkGeneration[2]; // rewinds of the reader before the chunk was filled, written like chunkLength
+    uint8_t current;            // chunk of the decoder, NO_CHUNK before the first chunk arrived
+    size_t position;            // in the current chunk
+    QueueHandle_t requests;     // chunks to fill and rewinds
+    QueueHandle_t filled;       // filled chunks, in file order
+    volatile bool running;
+    volatile bool stopped;
+    TaskHandle_t readerTask;
+    uint8_t readerGeneration;   // rewinds done by the reader
+    uint8_t generation;         // rewinds requested by the decoder, older chunks are dropped
+    bool rewinding;             // no chunk of the requested rewind arrived yet
+
+    // playback
+    uint32_t frame;             // index of the next frame
+    uint64_t pendingFrameTime;  // elapsed time which did not result in a whole frame yet (us * fps)
+    bool failed;                // the file is corrupt, the playback stopped
+
+    bool startReader();
+    void stopReader();
+    static void task(void *parameter);
+    void fill(uint8_t chunk);
+
+    bool read(uint8_t *out, size_t length);
+    bool nextChunk(TickType_t wait);
+    bool decodeFrame(uint8_t *pixels);
+    bool abortFrame();
+};
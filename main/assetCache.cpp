@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "assetCache.hpp"
+
+const char *AssetCache::TAG = "AssetCache";
+
+AssetCache::AssetCache() : mounted(false)
+{
+}
+
+AssetCache::~AssetCache()
+{
+    if (mounted)
+    {
+        esp_vfs_spiffs_unregister(NULL);
+    }
+}
+
+/**
+ * @brief Mount the SPIFFS partition. Called once, the files stay accessible afterwards.
+ */
+esp_err_t AssetCache::mount()
+{
+    if (mounted)
+    {
+        return ESP_OK;
+    }
+
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = BASE_PATH,
+        .partition_label = NULL,
+        .max_files = 5,
+        .format_if_mount_failed = false,
+    };
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+
+    if (ret != ESP_OK) {
+        if (ret == ESP_FAIL) {
+            ESP_LOGE(TAG, "Failed to mount or format filesystem");
+        } else if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
+        } else {
+            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
+        }
+        return ret;
+    }
+    mounted = true;
+
+    size_t total = 0, used = 0;
+    ret = esp_spiffs_info(NULL, &total, &used);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Read a file into the cache, the compressed "<file>.gz" is preferred.
+ *
+ * @param uri the URI the file is served under
+ * @param file the name of the file in the SPIFFS partition
+ * @param type the Content-Type
+ * @return ESP_ERR_NOT_FOUND if neither file exists
+ */
+esp_err_t AssetCache::load(const char *uri, const char *file, const char *type)
+{
+    Asset asset;
+    asset.uri = uri;
+    asset.type = type;
+
+    std::string path = std::string(BASE_PATH) + "/" + file;
+    asset.gzip = readFile(path + ".gz", asset.data);
+    if (!asset.gzip && !readFile(path, asset.data))
+    {
+        ESP_LOGE(TAG, "%s not found", file);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t hash = 2166136261u;
+    for (uint8_t byte : asset.data)
+    {
+        hash = (hash ^ byte) * 16777619u;
+    }
+    snprintf(asset.etag, sizeof(asset.etag), "\"%08x\"", hash);
+
+    ESP_LOGI(TAG, "Loaded %s%s (%d bytes) for %s", file, asset.gzip ? ".gz" : "", asset.data.size(), uri);
+    assets.push_back(std::move(asset));
+    return ESP_OK;
+}
+
+/**
+ * @return the asset served under the URI or NULL
+ */
+const Asset *AssetCache::find(const char *uri) const
+{
+    for (const Asset &asset : assets)
+    {
+        if (asset.uri == uri)
+        {
+            return &asset;
+        }
+    }
+    return NULL;
+}
+
+bool AssetCache::readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open %s for reading", path.c_str());
+        return false;
+    }
+    data.resize(st.st_size);
+    size_t read = fread(data.data(), 1, data.size(), file);
+    fclose(file);
+    data.resize(read);
+    return read == (size_t)st.st_size;
+}
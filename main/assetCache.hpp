@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "esp_err.h"
+
+/**
+ * @brief A static file held in RAM. data is gzip compressed if gzip is set.
+ */
+struct Asset {
+    std::string uri;
+    const char *type;
+    bool gzip;
+    char etag[11];              // quoted FNV-1a hash of data
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Static files which are read from SPIFFS once at startup.
+ *
+ * The build gzips the files of data/ (see spiffs_data in the CMakeLists.txt / Makefile),
+ * a file is loaded from "<name>.gz" and served with Content-Encoding: gzip, if there
+ * is only the uncompressed file it is loaded as it is.
+ */
+class AssetCache {
+public:
+    static const char *TAG;
+    static constexpr const char *BASE_PATH = "/spiffs";
+
+    AssetCache();
+    ~AssetCache();
+
+    esp_err_t mount();
+    esp_err_t load(const char *uri, const char *file, const char *type);
+    const Asset *find(const char *uri) const;
+
+private:
+    bool mounted;
+    std::vector<Asset> assets;
+
+    static bool readFile(const std::string &path, std::vector<uint8_t> &data);
+};
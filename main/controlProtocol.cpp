@@ -0,0 +1,360 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "controlProtocol.hpp"
+
+static inline uint16_t be16(const uint8_t *data)
+{
+    return (uint16_t)data[0] << 8 | data[1];
+}
+
+static inline uint8_t *putBe16(uint8_t *data, uint16_t value)
+{
+    data[0] = value >> 8;
+    data[1] = value;
+    return data + 2;
+}
+
+const char *ControlProtocol::TAG = "ControlProtocol";
+
+ControlProtocol::ControlProtocol(Controller &controller) :
+    controller(controller),
+    state{
+        .effect = controller.getEffect(),
+        .effectSpeed = controller.getEffectSpeed(),
+        .color = controller.getTargetColor(),
+        .brightness = controller.getTargetBrightness(),
+        .transitionMs = controller.getTransitionDuration(),
+        .rainbowSpeed = controller.getRainbowSpeed(),
+        .rainbowSpread = controller.getRainbowSpread(),
+    },
+    stateChanged(false),
+    streamSwitches(controller.getStreamSwitches())
+{
+}
+
+/**
+ * @brief Post a command to the controller and update the state.
+ * @return false if the command queue of the controller is full
+ */
+bool ControlProtocol::set(ControllerField field, uint32_t value)
+{
+    if (!controller.post(field, value))
+    {
+        return false;
+    }
+
+    uint8_t previous[STATE_MESSAGE_LENGTH], current[STATE_MESSAGE_LENGTH];
+    encodeState(previous);
+    switch (field)
+    {
+        case FIELD_TRANSITION:
+            state.transitionMs = value;
+            break;
+        case FIELD_EFFECT_SPEED:
+            state.effectSpeed = value;
+            break;
+        case FIELD_RAINBOW_SPEED:
+            state.rainbowSpeed = value;
+            break;
+        case FIELD_RAINBOW_SPREAD:
+            state.rainbowSpread = value;
+            break;
+        case FIELD_COLOR:
+            state.color = ControllerCommand::unpackColor(value);
+            break;
+        case FIELD_BRIGHTNESS:
+            state.brightness = value;
+            break;
+        case FIELD_EFFECT:
+            state.effect = (Effect)value;
+            break;
+        case FIELD_RAINBOW:
+            state.rainbowSpeed = value >> 16;
+            state.rainbowSpread = value & 0xffff;
+            break;
+        default:
+            break;
+    }
+    encodeState(current);
+    stateChanged |= memcmp(previous, current, STATE_MESSAGE_LENGTH) != 0;
+    return true;
+}
+
+/**
+ * @brief Note that a frame was uploaded, the controller switches to the STREAM effect.
+ * @return true if the effect changed
+ */
+bool ControlProtocol::markStreaming()
+{
+    if (state.effect == STREAM)
+    {
+        return false;
+    }
+    state.effect = STREAM;
+    stateChanged = true;
+    return true;
+}
+
+/**
+ * @brief Take over the switches of the controller to the STREAM effect, e.g. by the
+ * realtime receiver, which uploads without the protocol.
+ * @return true if the effect changed
+ */
+bool ControlProtocol::syncStreaming()
+{
+    const uint32_t switches = controller.getStreamSwitches();
+    if (switches == streamSwitches)
+    {
+        return false;
+    }
+    streamSwitches = switches;
+    return markStreaming();
+}
+
+/**
+ * @brief Whether the state changed since the last call, the clients get the new state.
+ */
+bool ControlProtocol::takeStateChange()
+{
+    syncStreaming();
+    bool changed = stateChanged;
+    stateChanged = false;
+    return changed;
+}
+
+/**
+ * @brief Apply the commands of a message (see ControlOpcode).
+ *
+ * @param failedOpcode the opcode of the failing command if the result is not CONTROL_OK
+ */
+ControlError ControlProtocol::handle(const uint8_t *message, size_t length, uint8_t &failedOpcode)
+{
+    const uint8_t *end = message + length;
+    while (message < end)
+    {
+        failedOpcode = *message++;
+        const size_t left = end - message;
+        size_t needed;
+        switch (failedOpcode)
+        {
+            case OP_EFFECT:
+            case OP_EFFECT_SPEED:
+            case OP_BRIGHTNESS:
+                needed = 1;
+                break;
+            case OP_COLOR:
+                needed = 3;
+                break;
+            case OP_TRANSITION:
+                needed = 2;
+                break;
+            case OP_RAINBOW:
+                needed = 4;
+                break;
+            case OP_PIXELS:
+                needed = PIXELS_HEADER_LENGTH - 1;
+                break;
+            case OP_SPARSE:
+                needed = 1;
+                break;
+            default:
+                return CONTROL_UNKNOWN_OPCODE;
+        }
+        if (left < needed)
+        {
+            return CONTROL_TRUNCATED;
+        }
+
+        bool queued = true;
+        switch (failedOpcode)
+        {
+            case OP_EFFECT:
+                if (message[0] >= EFFECT_COUNT)
+                {
+                    return CONTROL_INVALID_VALUE;
+                }
+                queued = set(FIELD_EFFECT, message[0]);
+                break;
+            case OP_EFFECT_SPEED:
+                queued = set(FIELD_EFFECT_SPEED, message[0]);
+                break;
+            case OP_BRIGHTNESS:
+                queued = set(FIELD_BRIGHTNESS, message[0]);
+                break;
+            case OP_COLOR:
+                queued = set(FIELD_COLOR, ControllerCommand::packColor(RgbColor(message[0], message[1], message[2])));
+                break;
+            case OP_TRANSITION:
+                queued = set(FIELD_TRANSITION, be16(message));
+                break;
+            case OP_RAINBOW:
+                // one command, so both values are applied or none
+                queued = set(FIELD_RAINBOW, ControllerCommand::packRainbow(be16(message), be16(message + 2)));
+                break;
+            case OP_PIXELS:
+                // the colors take the rest of the message
+                return writePixels(be16(message), message + needed, left - needed);
+            case OP_SPARSE:
+            {
+                size_t errorOffset;
+                return writeSparse(message, left, errorOffset);
+            }
+        }
+        if (!queued)
+        {
+            return CONTROL_BUSY;
+        }
+        message += needed;
+    }
+    return CONTROL_OK;
+}
+
+/**
+ * @brief Copy the colors into the stream buffer and show them with the next frame.
+ * The controller switches to the STREAM effect.
+ */
+ControlError ControlProtocol::writePixels(size_t firstPixel, const uint8_t *data, size_t length)
+{
+    const size_t channels = controller.getChannelsPerPixel();
+    const size_t offset = firstPixel * channels;
+    if (length == 0 || length % channels != 0 || offset + length > controller.getStreamBufferSize())
+    {
+        return CONTROL_OUT_OF_RANGE;
+    }
+
+    uint8_t *buffer = acquireStreamBuffer();
+    if (buffer == nullptr)
+    {
+        return CONTROL_BUSY;
+    }
+    memcpy(buffer + offset, data, length);
+    controller.releaseStreamBuffer(true);
+
+    markStreaming();
+    return CONTROL_OK;
+}
+
+/**
+ * @brief Apply a sparse update (see SparseRecord) to the stream buffer and show it with
+ * the next frame. Nothing is applied if a record is invalid. The controller switches to
+ * the STREAM effect, the other pixels keep the colors of the stream buffer.
+ *
+ * @param errorOffset the offset of the first invalid record
+ */
+ControlError ControlProtocol::writeSparse(const uint8_t *data, size_t length, size_t &errorOffset)
+{
+    ControlError error = validateSparse(data, length, errorOffset);
+    if (error != CONTROL_OK)
+    {
+        return error;
+    }
+    uint8_t *buffer = acquireStreamBuffer();
+    if (buffer == nullptr)
+    {
+        errorOffset = 0;
+        return CONTROL_BUSY;
+    }
+
+    const size_t channels = controller.getChannelsPerPixel();
+    const uint8_t *end = data + length;
+    while (data < end)
+    {
+        const bool run = data[0] == SPARSE_RUN;
+        uint8_t *out = buffer + be16(data + 1) * channels;
+        const size_t bytes = (run ? be16(data + 3) : 1) * channels;
+        data += run ? 5 : 3;
+
+        // a run doubles the filled part with each copy
+        memcpy(out, data, channels);
+        for (size_t filled = channels; filled < bytes; filled *= 2)
+        {
+            memcpy(out + filled, out, filled < bytes - filled ? filled : bytes - filled);
+        }
+        data += channels;
+    }
+    controller.releaseStreamBuffer(true);
+
+    markStreaming();
+    return CONTROL_OK;
+}
+
+ControlError ControlProtocol::validateSparse(const uint8_t *data, size_t length, size_t &errorOffset) const
+{
+    const size_t channels = controller.getChannelsPerPixel();
+    const size_t pixels = controller.getPixelCount();
+    errorOffset = 0;
+    if (length == 0)
+    {
+        return CONTROL_TRUNCATED;
+    }
+
+    for (size_t offset = 0; offset < length; )
+    {
+        errorOffset = offset;
+        const uint8_t *record = data + offset;
+        const size_t header = record[0] == SPARSE_PIXEL ? 3 : record[0] == SPARSE_RUN ? 5 : 0;
+        if (header == 0)
+        {
+            return CONTROL_INVALID_VALUE;
+        }
+        if (length - offset < header + channels)
+        {
+            return CONTROL_TRUNCATED;
+        }
+        const size_t count = record[0] == SPARSE_RUN ? be16(record + 3) : 1;
+        if (count == 0 || be16(record + 1) + count > pixels)
+        {
+            return CONTROL_OUT_OF_RANGE;
+        }
+        offset += header + channels;
+    }
+    return CONTROL_OK;
+}
+
+/**
+ * @brief The stream buffer, the controller only holds it while it copies it into the pixels.
+ * @return nullptr if it is still busy after 3 ticks
+ */
+uint8_t *ControlProtocol::acquireStreamBuffer()
+{
+    uint8_t *buffer = controller.acquireStreamBuffer();
+    for (uint8_t retry = 0; buffer == nullptr && retry < 3; retry++)
+    {
+        vTaskDelay(1);
+        buffer = controller.acquireStreamBuffer();
+    }
+    return buffer;
+}
+
+/**
+ * @brief Write the state message (STATE_MESSAGE_LENGTH bytes).
+ * @return the length of the message
+ */
+size_t ControlProtocol::encodeState(uint8_t *message) const
+{
+    uint8_t *p = message;
+    *p++ = OP_STATE;
+    *p++ = state.effect;
+    *p++ = state.effectSpeed;
+    *p++ = state.color.r;
+    *p++ = state.color.g;
+    *p++ = state.color.b;
+    *p++ = state.brightness;
+    p = putBe16(p, state.transitionMs);
+    p = putBe16(p, state.rainbowSpeed);
+    p = putBe16(p, state.rainbowSpread);
+    return p - message;
+}
+
+/**
+ * @brief Write the error message (ERROR_MESSAGE_LENGTH bytes).
+ * @return the length of the message
+ */
+size_t ControlProtocol::encodeError(uint8_t *message, uint8_t opcode, ControlError error)
+{
+    message[0] = OP_ERROR;
+    message[1] = opcode;
+    message[2] = error;
+    return ERROR_MESSAGE_LENGTH;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "controller.hpp"
+
+/**
+ * @brief Binary messages of the WebSocket control channel (/ws).
+ *
+ * A message from a client holds one or more commands back to back, each starts with
+ * its opcode, 16 bit values are big-endian:
+ *   0x01 effect          u8 effect (see Effect)
+ *   0x02 effect speed    u8
+ *   0x03 color           u8 r, u8 g, u8 b
+ *   0x04 brightness      u8
+ *   0x05 transition      u16 ms
+ *   0x06 rainbow         u16 speed, u16 spread
+ *   0x10 pixels          u16 first pixel, the colors (R, G, B (, W)) up to the end of the message
+ *   0x11 sparse          records up to the end of the message, each one is
+ *                        0x01 u16 pixel, color          one pixel
+ *                        0x02 u16 first, u16 count, color  a run of pixels with the same color
+ * The pixels and sparse commands must be the last one, they switch to the STREAM effect.
+ * A sparse update is checked completely before it is applied, it is shown with one frame.
+ *
+ * The server answers with (and broadcasts to all clients after every change):
+ *   0x80 state           u8 effect, u8 effect speed, u8 r, u8 g, u8 b, u8 brightness,
+ *                        u16 transition, u16 rainbow speed, u16 rainbow spread
+ *   0xff error           u8 opcode of the failing command, u8 ControlError
+ * The commands before a failing one are applied.
+ */
+enum ControlOpcode : uint8_t {
+    OP_EFFECT = 0x01,
+    OP_EFFECT_SPEED = 0x02,
+    OP_COLOR = 0x03,
+    OP_BRIGHTNESS = 0x04,
+    OP_TRANSITION = 0x05,
+    OP_RAINBOW = 0x06,
+    OP_PIXELS = 0x10,
+    OP_SPARSE = 0x11,
+    OP_STATE = 0x80,
+    OP_ERROR = 0xff,
+};
+
+enum SparseRecord : uint8_t {
+    SPARSE_PIXEL = 0x01,
+    SPARSE_RUN = 0x02,
+};
+
+enum ControlError : uint8_t {
+    CONTROL_OK = 0,
+    CONTROL_UNKNOWN_OPCODE,
+    CONTROL_TRUNCATED,          // the message ended inside the command
+    CONTROL_INVALID_VALUE,
+    CONTROL_OUT_OF_RANGE,       // the pixels do not fit into the strip
+    CONTROL_BUSY,               // the command queue is full or the stream buffer is in use
+};
+
+/**
+ * @brief State of the controller as requested by the clients. The controller applies
+ * it with the next frame, so it is tracked here instead of being read back. Only a
+ * switch to the STREAM effect by an upload of another task is read back (see syncStreaming()).
+ */
+struct ControlState {
+    Effect effect;
+    uint8_t effectSpeed;
+    RgbColor color;
+    uint8_t brightness;
+    uint16_t transitionMs;
+    uint16_t rainbowSpeed;
+    uint16_t rainbowSpread;
+};
+
+/**
+ * @brief Applies control messages to the controller and keeps track of the requested state.
+ * The functions must be called by one task (the HTTP server task), the commands are
+ * posted to the controller (see Controller::post()).
+ */
+class ControlProtocol {
+public:
+    static const char *TAG;
+    static constexpr size_t STATE_MESSAGE_LENGTH = 13;
+    static constexpr size_t ERROR_MESSAGE_LENGTH = 3;
+    static constexpr size_t PIXELS_HEADER_LENGTH = 3;
+    static constexpr size_t MAX_MESSAGE_LENGTH = PIXELS_HEADER_LENGTH + WS2812::MAX_PIXEL_BYTES;   // of any strip
+
+    ControlProtocol(Controller &controller);
+
+    ControlError handle(const uint8_t *message, size_t length, uint8_t &failedOpcode);
+    bool set(ControllerField field, uint32_t value);
+    bool markStreaming();
+    bool syncStreaming();
+    bool hasStreamSwitch() const { return controller.getStreamSwitches() != streamSwitches; }
+    ControlError writeSparse(const uint8_t *data, size_t length, size_t &errorOffset);
+    bool takeStateChange();
+
+    const ControlState &getState() const { return state; }
+    size_t getMaxMessageLength() const { return PIXELS_HEADER_LENGTH + controller.getStreamBufferSize(); }
+    size_t encodeState(uint8_t *message) const;
+    static size_t encodeError(uint8_t *message, uint8_t opcode, ControlError error);
+
+private:
+    Controller &controller;
+    ControlState state;
+    bool stateChanged;          // since the last takeStateChange()
+    uint32_t streamSwitches;    // of the controller which are in the state
+
+    ControlError writePixels(size_t firstPixel, const uint8_t *data, size_t length);
+    ControlError validateSparse(const uint8_t *data, size_t length, size_t &errorOffset) const;
+    uint8_t *acquireStreamBuffer();
+};
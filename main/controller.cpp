@@ -1,138 +1,528 @@
+#include <string.h>
 #include "controller.hpp"
-
-#define UPDATE_TRANSITION_COLOR(color, target) \
-    if (color < target)                        \
-    {                                          \
-        color++;                               \
-    }                                          \
-    else if (color > target)                   \
-    {                                          \
-        color--;                               \
-    }
-
-#define UPDATE_RAINBOW_CYCLE()
+#include "hueWheel.hpp"
+#include "rtosTimestamp.hpp"
 
 
 const char *Controller::TAG = "Controller";
 
-Controller::Controller(std::unique_ptr<WS2812> ledPtr) : 
+Controller::Controller(StripPtr ledPtr) : 
     led(std::move(ledPtr)),
     effect(SOLID),
     effectSpeed(50),
-    currentColor(RgbColor(0, 0, 0)),
     targetColor(RgbColor(0, 0, 0)),
     currentBrightness(255),
     targetBrightness(255),
-    inTransition(false),
-    latestUpdateShown(false)
+    brightnessFrom(255),
+    transitionMs(500),
+    fadeFrame(led->getPixelBufferSize()),
+    frameFade(fadeFrame.data(), fadeFrame.size()),
+    brightnessFade(NULL, 0),
+    fadeRequested(false),
+    brightnessFadeRequested(false),
+    latestUpdateShown(false),
+    pendingStepTime(0),
+    renderStats{},
+    segmentLayout{},
+    segmentStates{},
+    streamBuffer(led->getPixelBufferSize()),
+    streamState(STREAM_IDLE),
+    streamBefore(STREAM_IDLE),
+    streamSwitches(0),
+    animation(NULL),
+    hue(0),
+    rainbowSpeed(43),
+    rainbowSpread(4283)
 {
-    led->fill(currentColor);
-    led->show();
+    led->fill(targetColor);
+    led->present();
 }
 
 Controller::~Controller()
 {
 }
 
-void Controller::loop()
+/**
+ * @brief Queue a parameter change for the next frame. This is the only function which
+ * may be called from another task (one producer, e.g. the HTTP server task).
+ * It never blocks. If the same field is posted several times before the next
+ * frame, only the latest value is applied.
+ *
+ * @return false if the command queue is full
+ */
+bool Controller::post(ControllerField field, uint32_t value)
+{
+    return commands.push(ControllerCommand{field, value});
+}
+
+/**
+ * @brief Queue a new segment layout for the next frame, like post() only from one task.
+ * The layout must be valid (see validateSegments()).
+ *
+ * @return false if the queue is full
+ */
+bool Controller::postSegments(const SegmentLayout &layout)
+{
+    return segmentCommands.push(layout);
+}
+
+/**
+ * @brief Hand an animation to the ANIMATION effect with the next frame, like post()
+ * only from one task (e.g. app_main after the SPIFFS partition was mounted).
+ *
+ * @return false if the frames do not match the strip or the queue is full
+ */
+bool Controller::postAnimation(AnimationPlayer *player)
+{
+    return (!player || matchesStrip(*player)) && animationCommands.push(player);
+}
+
+/**
+ * @brief Check the segments against the strip.
+ *
+ * @param index the first invalid segment
+ * @return nullptr if the layout is valid, otherwise the error
+ */
+const char *Controller::validateSegments(const SegmentLayout &layout, uint16_t pixelCount, uint8_t &index)
 {
-    // head to the target values befor the effect is shown
-    if (inTransition)
+    uint32_t end = 0;
+    for (index = 0; index < layout.count; index++)
     {
-        UPDATE_TRANSITION_COLOR(currentColor.r, targetColor.r);
-        UPDATE_TRANSITION_COLOR(currentColor.g, targetColor.g);
-        UPDATE_TRANSITION_COLOR(currentColor.b, targetColor.b);
-        latestUpdateShown = false;
+        const Segment &segment = layout.segments[index];
+        if (segment.length == 0 || (uint32_t)segment.start + segment.length > pixelCount)
+        {
+            return "The segment must have at least one pixel and fit into the strip";
+        }
+        if (segment.start < end)
+        {
+            return "The segments must be sorted by start and must not overlap";
+        }
+        if (segment.effect != SOLID && segment.effect != RAINBOW && segment.effect != RAINBOW_CYCLE)
+        {
+            return "Invalid effect. Must be an integer between 0 and 2";
+        }
+        end = segment.start + segment.length;
     }
+    return layout.count <= SegmentLayout::MAX_SEGMENTS ? nullptr : "Too many segments";
+}
 
-    setEffectPixels();
-    
-    if (!latestUpdateShown && led->isReady())
+/**
+ * @brief Drain the command queues and apply the latest value of each field once.
+ */
+void Controller::applyCommands()
+{
+    AnimationPlayer *player;
+    while (animationCommands.pop(player))
     {
-        led->show();
-        latestUpdateShown = true;
+        setAnimation(player);
     }
-    else
+
+    SegmentLayout layout;
+    bool layoutPosted = false;
+    while (segmentCommands.pop(layout))
     {
-        latestUpdateShown = false;
+        layoutPosted = true;
+    }
+    if (layoutPosted)
+    {
+        setSegments(layout);
+    }
+
+    uint32_t latest[FIELD_COUNT];
+    uint8_t posted = 0;      // bit mask of the posted fields
+    static_assert(FIELD_COUNT <= 8, "the fields do not fit into the mask");
+    ControllerCommand command;
+
+    while (commands.pop(command))
+    {
+        if (command.field < FIELD_COUNT)
+        {
+            latest[command.field] = command.value;
+            posted |= 1 << command.field;
+        }
+    }
+
+    for (uint8_t field = 0; posted; field++, posted >>= 1)
+    {
+        if (!(posted & 1))
+        {
+            continue;
+        }
+        uint32_t value = latest[field];
+        switch (field)
+        {
+        case FIELD_TRANSITION:
+            setTransitionDuration(value);
+            break;
+        case FIELD_EFFECT_SPEED:
+            setEffectSpeed(value);
+            break;
+        case FIELD_RAINBOW_SPEED:
+            setRainbowSpeed(value);
+            break;
+        case FIELD_RAINBOW_SPREAD:
+            setRainbowSpread(value);
+            break;
+        case FIELD_COLOR:
+            setTargetColor(ControllerCommand::unpackColor(value));
+            break;
+        case FIELD_BRIGHTNESS:
+            setTargetBrightness(value);
+            break;
+        case FIELD_EFFECT:
+            ESP_LOGI(Controller::TAG, "Setting effect to %d", (int)value);
+            setEffect((Effect)value);
+            break;
+        case FIELD_RAINBOW:
+            setRainbowSpeed(value >> 16);
+            setRainbowSpread(value & 0xffff);
+            break;
+        }
+    }
+
+    // a completed upload (/frame, UDP) switches to the stream
+    if (streamState == STREAM_READY && effect != STREAM)
+    {
+        setEffect(STREAM);
+        streamSwitches = streamSwitches + 1;   // only written by this task
+    }
+}
+
+/**
+ * @brief Advance the effect by one step and present the frame.
+ * The fades advance by the duration of one step.
+ */
+void Controller::loop()
+{
+    applyCommands();
+    uint32_t stepsPerSecond = (uint32_t)effectSpeed * configTICK_RATE_HZ;
+    measureRender(1, stepsPerSecond ? 1000000 / stepsPerSecond : 0);
+}
+
+/**
+ * @brief Advance the effect by the elapsed time and present one frame.
+ * The effect advances effectSpeed steps per RTOS tick, independent of the
+ * frame rate. Fractions of a step are carried to the next call.
+ *
+ * @param elapsedUs time since the last update
+ */
+void Controller::update(uint32_t elapsedUs)
+{
+    pendingStepTime += (uint64_t)elapsedUs * effectSpeed * configTICK_RATE_HZ;
+    uint32_t steps = pendingStepTime / 1000000;
+    pendingStepTime -= (uint64_t)steps * 1000000;
+
+    applyCommands();
+    measureRender(steps, elapsedUs);
+}
+
+/**
+ * @brief render() and add its duration to the stats of the current effect.
+ */
+void Controller::measureRender(uint32_t steps, uint32_t elapsedUs)
+{
+    RenderStats &stats = renderStats[effect];
+    RtosTimestamp start;
+    render(steps, elapsedUs);
+    uint32_t us = start.tickDiff() / (F_CPU / 1000000);
+
+    stats.frames++;
+    stats.totalUs += us;
+    if (us > stats.maxUs)
+    {
+        stats.maxUs = us;
     }
 }
 
-void Controller::nextRainbowColor(uint8_t *colorMask, int8_t *sign, RgbColor *target, uint8_t offset)
+/**
+ * @brief Render the target effect and blend it with the frame which was shown
+ * when the effect or the color changed (see Crossfade). The brightness ramps
+ * with its own fade of the same duration.
+ */
+void Controller::render(uint32_t steps, uint32_t elapsedUs)
 {
-    uint8_t* colorPtr = reinterpret_cast<uint8_t*>(target);
-    int16_t newVal = (colorPtr[*colorMask] + *sign * offset);
-    uint8_t nextColorMask = (*colorMask + 2) % 3;
-    
-    if (newVal < 0) {
-        colorPtr[*colorMask] = 0;
-        colorPtr[nextColorMask] -= newVal;
-    } else if (newVal > 255) {
-        colorPtr[*colorMask] = 255;
-        colorPtr[nextColorMask] -= newVal % 255;
-    } else {
-        colorPtr[*colorMask] = newVal;
+    // a new fade starts from the frame which is shown now, also if another fade is running
+    if (fadeRequested)
+    {
+        // the delta frames of an animation build on the pixels, a blend would change them
+        frameFade.start(led->getPixelBuffer(), effect == ANIMATION ? 0 : transitionMs);
+        fadeRequested = false;
+    }
+    if (brightnessFadeRequested)
+    {
+        brightnessFrom = currentBrightness;
+        brightnessFade.start(transitionMs);
+        brightnessFadeRequested = false;
+    }
+
+    bool fading = frameFade.isActive();
+    frameFade.advance(elapsedUs);
+    brightnessFade.advance(elapsedUs);
+
+    uint8_t brightness = Crossfade::blend(brightnessFrom, targetBrightness, brightnessFade.getWeight());
+    if (brightness != currentBrightness)
+    {
+        currentBrightness = brightness;
+        led->setBrightness(currentBrightness);
+        latestUpdateShown = false;
     }
 
-    
-    if (colorPtr[*colorMask] == 0 || colorPtr[*colorMask] == 255) {
-        *colorMask = (*colorMask + 2) % 3;
-        *sign = -*sign;
+    if (!setEffectPixels(steps, elapsedUs, fading))
+    {
+        // the pixels are unchanged, the frame is skipped
+        return;
+    }
+    if (fading)
+    {
+        frameFade.blendFrame(led->getPixelBuffer());
+    }
+
+    // the frame is sent by the transmitting task (see WS2812::transmitPending()),
+    // a steady effect does not present again
+    if (!latestUpdateShown)
+    {
+        led->present();
+        latestUpdateShown = true;
     }
 }
 
-void Controller::setEffectPixels()
+/**
+ * @brief Render the target effect into the pixels. The pixels are rendered again
+ * if the effect advanced, a fade is running or a parameter changed.
+ *
+ * @return false if the frame can not be rendered now (stream buffer in use)
+ */
+bool Controller::setEffectPixels(uint32_t steps, uint32_t elapsedUs, bool fading)
 {
+    bool outdated = fading || !latestUpdateShown;
+
+    if (segmentLayout.count && effect != STREAM && effect != ANIMATION)
+    {
+        renderSegments(elapsedUs, outdated);
+        return true;
+    }
+
     switch (effect)
     {
     case SOLID:
-        if (inTransition)
+        if (outdated)
         {
-            led->fill(currentColor);
+            led->fill(targetColor);
             latestUpdateShown = false;
-            inTransition = currentColor != targetColor;
         }
         break;
     case RAINBOW:
-        if (inTransition)
+        if (outdated || steps)
         {
-            inTransition = currentColor != targetColor;
-        } else {
-            nextRainbowColor(&phase, &sign, &currentColor, 1);
+            hue += rainbowSpeed * steps;
+            led->fill(hueToRgb(hue));
+            latestUpdateShown = false;
         }
-        led->fill(currentColor);
-        latestUpdateShown = false;
         break;
     case RAINBOW_CYCLE:
-        if (inTransition)
+        if (outdated || steps)
         {
-            inTransition = currentColor != targetColor;
-            led->fill(currentColor);
-        } else {
-            nextRainbowColor(&phase, &sign, &currentColor, 1);
-            led->setPixelColor(0, currentColor);
-
-            // clone the current color
-            uint8_t nextPhase = this->phase;
-            int8_t nextSign = this->sign;
-            RgbColor nextPixel = RgbColor(currentColor.r, currentColor.g, currentColor.b);
-            for (uint16_t i = 1; i < led->getPixelCount(); i++)
+            hue += rainbowSpeed * steps;
+
+            // each pixel is computed from its own hue, no state is carried between the pixels
+            uint16_t pixelHue = hue;
+            for (uint16_t i = 0; i < led->getPixelCount(); i++, pixelHue += rainbowSpread)
             {
-                nextRainbowColor(&nextPhase, &nextSign, &nextPixel, 100);
-                led->setPixelColor(i, nextPixel);
+                led->setPixelColor(i, hueToRgb(pixelHue));
             }
+            latestUpdateShown = false;
         }
-        latestUpdateShown = false;
+        break;
+    case STREAM:
+        if (!readStreamBuffer(outdated))
+        {
+            return false;
+        }
+        break;
+    case ANIMATION:
+        decodeAnimation(elapsedUs, outdated);
         break;
     default:
         ESP_LOGI(Controller::TAG, "Unimplemented effect set: %d", effect);
     }
+    return true;
+}
+
+static inline RgbColor scaleColor(const RgbColor &color, uint8_t brightness)
+{
+    if (brightness == 255)
+    {
+        return color;
+    }
+    return RgbColor(color.r * (brightness + 1) >> 8, color.g * (brightness + 1) >> 8, color.b * (brightness + 1) >> 8);
+}
+
+/**
+ * @brief Render all segments in one pass over the pixels, each pixel is written once
+ * (the pixels between the segments are turned off). Each segment advances by the
+ * elapsed time with its own speed. Nothing is written if no segment advanced and
+ * the pixels are current.
+ */
+void Controller::renderSegments(uint32_t elapsedUs, bool outdated)
+{
+    bool advanced = false;
+    uint32_t steps[SegmentLayout::MAX_SEGMENTS];
+    for (uint8_t i = 0; i < segmentLayout.count; i++)
+    {
+        const Segment &segment = segmentLayout.segments[i];
+        SegmentState &state = segmentStates[i];
+        state.pendingStepTime += (uint64_t)elapsedUs * segment.effectSpeed * configTICK_RATE_HZ;
+        steps[i] = state.pendingStepTime / 1000000;
+        state.pendingStepTime -= (uint64_t)steps[i] * 1000000;
+        advanced |= steps[i] && segment.effect != SOLID;
+    }
+    if (!outdated && !advanced)
+    {
+        return;
+    }
+
+    const RgbColor off(0, 0, 0);
+    uint16_t pixel = 0;
+    for (uint8_t i = 0; i < segmentLayout.count; i++)
+    {
+        const Segment &segment = segmentLayout.segments[i];
+        SegmentState &state = segmentStates[i];
+        for (; pixel < segment.start; pixel++)
+        {
+            led->setPixelColor(pixel, off);
+        }
+
+        const uint16_t end = segment.start + segment.length;
+        state.hue += rainbowSpeed * steps[i];
+        switch (segment.effect)
+        {
+        case RAINBOW_CYCLE:
+        {
+            uint16_t pixelHue = state.hue;
+            for (; pixel < end; pixel++, pixelHue += rainbowSpread)
+            {
+                led->setPixelColor(pixel, scaleColor(hueToRgb(pixelHue), segment.brightness));
+            }
+            break;
+        }
+        default:
+        {
+            const RgbColor color = scaleColor(segment.effect == RAINBOW ? hueToRgb(state.hue) : segment.color, segment.brightness);
+            for (; pixel < end; pixel++)
+            {
+                led->setPixelColor(pixel, color);
+            }
+            break;
+        }
+        }
+    }
+    for (const uint16_t count = getPixelCount(); pixel < count; pixel++)
+    {
+        led->setPixelColor(pixel, off);
+    }
+    latestUpdateShown = false;
+}
+
+/**
+ * @brief Copy the stream buffer into the pixels if a frame was uploaded or the pixels are outdated.
+ * After a failed upload the pixels keep their content.
+ *
+ * @return false if an upload is running and the pixels are outdated
+ */
+bool Controller::readStreamBuffer(bool outdated)
+{
+    taskENTER_CRITICAL();
+    StreamState state = streamState;
+    bool read = state == STREAM_READY || (state == STREAM_IDLE && outdated);
+    if (read)
+    {
+        streamState = STREAM_READING;
+    }
+    taskEXIT_CRITICAL();
+
+    if (!read)
+    {
+        return !outdated || state == STREAM_TORN;
+    }
+
+    memcpy(led->getPixelBuffer(), streamBuffer.data(), streamBuffer.size());
+    latestUpdateShown = false;
+    streamState = STREAM_IDLE;
+    return true;
+}
+
+/**
+ * @brief Decode the due frames of the animation into the pixels. Between the frames
+ * the pixels keep the last frame. Without an animation the pixels are off.
+ */
+void Controller::decodeAnimation(uint32_t elapsedUs, bool outdated)
+{
+    if (!animation)
+    {
+        if (outdated)
+        {
+            led->fill(RgbColor(0, 0, 0));
+            latestUpdateShown = false;
+        }
+        return;
+    }
+
+    uint32_t frames = animation->framesDue(elapsedUs);
+    if (frames)
+    {
+        animation->decode(frames, led->getPixelBuffer());
+        latestUpdateShown = false;
+    }
+}
+
+/**
+ * @brief Get exclusive access to the stream buffer to upload a frame (pixels in R, G, B (, W)
+ * order, see getChannelsPerPixel()). The buffer keeps its content between uploads,
+ * so parts of the frame can be updated. The STREAM effect shows the buffer, a
+ * completed upload switches the controller to the STREAM effect.
+ * May be called from any task, it never blocks.
+ *
+ * @return the buffer with getStreamBufferSize() bytes, nullptr if another task uses it
+ */
+uint8_t *Controller::acquireStreamBuffer()
+{
+    taskENTER_CRITICAL();
+    StreamState state = streamState;
+    bool acquired = state == STREAM_IDLE || state == STREAM_READY || state == STREAM_TORN;
+    if (acquired)
+    {
+        streamBefore = state;
+        streamState = STREAM_WRITING;
+    }
+    taskEXIT_CRITICAL();
+
+    return acquired ? streamBuffer.data() : nullptr;
+}
+
+/**
+ * @brief Release the stream buffer after acquireStreamBuffer().
+ *
+ * @param show the frame is complete and shown with the next frame
+ */
+void Controller::releaseStreamBuffer(bool show)
+{
+    streamState = show ? STREAM_READY : streamBefore;
+}
+
+/**
+ * @brief Release the stream buffer after an upload failed, it holds a part of the
+ * frame. The buffer is not shown until an upload completes a frame, the pixels keep
+ * the last frame.
+ */
+void Controller::discardStreamBuffer()
+{
+    streamState = STREAM_TORN;
 }
 
 void Controller::setEffect(Effect effect)
 {
     this->effect = effect;
-    inTransition = true;
+    fadeRequested = true;
     latestUpdateShown = false;
 
     // set variables for the effect
@@ -140,9 +530,14 @@ void Controller::setEffect(Effect effect)
     {
         case RAINBOW:
         case RAINBOW_CYCLE:
-            targetColor = {255, 0, 0};
-            phase = 1;
-            sign = 1;
+            hue = 0;
+            break;
+        case ANIMATION:
+            // the delta frames need the previous frame, which another effect overwrote
+            if (animation)
+            {
+                animation->restart();
+            }
             break;
         default:
             break;
@@ -154,14 +549,87 @@ void Controller::setEffectSpeed(uint8_t effectSpeed)
     this->effectSpeed = effectSpeed;
 }
 
+/**
+ * @brief Hue step per loop of the rainbow effects (65536 is a full turn of the wheel).
+ */
+void Controller::setRainbowSpeed(uint16_t rainbowSpeed)
+{
+    this->rainbowSpeed = rainbowSpeed;
+}
+
+/**
+ * @brief Hue step between two neighboured pixels of RAINBOW_CYCLE (65536 is a full turn of the wheel).
+ */
+void Controller::setRainbowSpread(uint16_t rainbowSpread)
+{
+    this->rainbowSpread = rainbowSpread;
+}
+
+/**
+ * @brief Duration of the fades between two effects, colors or brightness values.
+ * @param transitionMs 0 switches immediately
+ */
+void Controller::setTransitionDuration(uint16_t transitionMs)
+{
+    this->transitionMs = transitionMs;
+}
+
 void Controller::setTargetColor(RgbColor targetColor)
 {
     this->targetColor = targetColor;
-    inTransition = true;
+    fadeRequested = true;
+    latestUpdateShown = false;
+}
+
+/**
+ * @brief Replace the segments, the strip crossfades to the new layout.
+ * The effects of the segments start from the beginning.
+ */
+void Controller::setSegments(const SegmentLayout &layout)
+{
+    segmentLayout = layout;
+    for (uint8_t i = 0; i < SegmentLayout::MAX_SEGMENTS; i++)
+    {
+        segmentStates[i] = SegmentState{0, 0};
+    }
+    fadeRequested = true;
+    latestUpdateShown = false;
+}
+
+/**
+ * @brief Set the animation of the ANIMATION effect (NULL: none), its frames must have
+ * the pixels and the channels of the strip. The player is only used by the task which renders.
+ *
+ * @return false if the frames do not match the strip
+ */
+bool Controller::setAnimation(AnimationPlayer *player)
+{
+    if (player && !matchesStrip(*player))
+    {
+        return false;
+    }
+    animation = player;
+    if (effect == ANIMATION)
+    {
+        setEffect(ANIMATION);
+    }
+    return true;
+}
+
+bool Controller::matchesStrip(const AnimationPlayer &player) const
+{
+    const animation::Header &header = player.getHeader();
+    if (header.pixels != getPixelCount() || header.channels != getChannelsPerPixel())
+    {
+        ESP_LOGE(TAG, "The animation has %u pixels with %u channels, the strip %u pixels with %u channels",
+                 header.pixels, header.channels, getPixelCount(), getChannelsPerPixel());
+        return false;
+    }
+    return true;
 }
 
 void Controller::setTargetBrightness(uint8_t targetBrightness)
 {
     this->targetBrightness = targetBrightness;
-    inTransition = true;
+    brightnessFadeRequested = true;
 }
@@ -1,5 +1,8 @@
 #pragma once
 #include "ws2812.hpp"
+#include "crossfade.hpp"
+#include "spscRing.hpp"
+#include "animationPlayer.hpp"
 #include "esp_log.h"
 #include <memory>
 
@@ -7,19 +10,136 @@ enum Effect {
     SOLID = 0,
     RAINBOW,
     RAINBOW_CYCLE,
+    STREAM,                     // frames uploaded by other tasks (see acquireStreamBuffer())
+    ANIMATION,                  // pre-rendered frames from a file (see setAnimation())
 };
 
+static constexpr uint8_t EFFECT_COUNT = ANIMATION + 1;
+
+/**
+ * @brief Time spent in render() per effect since the start (loop() and update()).
+ */
+struct RenderStats {
+    uint32_t frames;
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+/**
+ * @brief A range of pixels with its own effect (see Controller::postSegments()).
+ * STREAM and ANIMATION are not available for segments, they show the whole strip.
+ */
+struct Segment {
+    uint16_t start;
+    uint16_t length;
+    Effect effect;
+    RgbColor color;             // of SOLID
+    uint8_t effectSpeed;        // steps per RTOS tick
+    uint8_t brightness;         // scales the colors of the segment, the strip brightness applies on top
+};
+
+/**
+ * @brief The segments of the strip, sorted by start and not overlapping.
+ * Pixels outside of the segments are off.
+ */
+struct SegmentLayout {
+    static constexpr uint8_t MAX_SEGMENTS = 8;
+
+    uint8_t count;              // 0: the whole strip shows the effect of the controller
+    Segment segments[MAX_SEGMENTS];
+};
+
+/**
+ * @brief Parameters which other tasks change with Controller::post().
+ * The commands of one frame are applied in this order.
+ */
+enum ControllerField : uint8_t {
+    FIELD_TRANSITION = 0,
+    FIELD_EFFECT_SPEED,
+    FIELD_RAINBOW_SPEED,
+    FIELD_RAINBOW_SPREAD,
+    FIELD_COLOR,                // packed with ControllerCommand::packColor()
+    FIELD_BRIGHTNESS,
+    FIELD_EFFECT,
+    FIELD_RAINBOW,              // speed and spread, packed with ControllerCommand::packRainbow()
+    FIELD_COUNT,
+};
+
+struct ControllerCommand {
+    ControllerField field;
+    uint32_t value;
+
+    static uint32_t packColor(const RgbColor &color)
+    {
+        return (uint32_t)color.r << 16 | color.g << 8 | color.b;
+    }
+
+    static RgbColor unpackColor(uint32_t value)
+    {
+        return RgbColor(value >> 16, value >> 8, value);
+    }
+
+    static uint32_t packRainbow(uint16_t speed, uint16_t spread)
+    {
+        return (uint32_t)speed << 16 | spread;
+    }
+};
+
+/**
+ * @brief Deleter of the strip of the controller. A strip which is not on the heap, e.g. in the
+ * static storage of create() in app_main (CONFIG_ESP_WS2812_STATIC_ALLOCATION), is only
+ * destructed. A std::unique_ptr<WS2812> converts to an owning StripPtr.
+ */
+struct StripDeleter {
+    bool onHeap;
+
+    explicit StripDeleter(bool onHeap = true) : onHeap(onHeap) {}
+    StripDeleter(std::default_delete<WS2812>) : onHeap(true) {}
+
+    void operator()(WS2812 *led) const
+    {
+        if (onHeap)
+        {
+            delete led;
+        }
+        else
+        {
+            led->~WS2812();
+        }
+    }
+};
+
+using StripPtr = std::unique_ptr<WS2812, StripDeleter>;
+
 class Controller {
 public:
     static const char *TAG;
-    Controller(const std::unique_ptr<WS2812> led);
+    Controller(StripPtr led);
     ~Controller();
     void loop(void);
-    
+    void update(uint32_t elapsedUs);
+    bool post(ControllerField field, uint32_t value);
+    bool postSegments(const SegmentLayout &layout);
+    bool postAnimation(AnimationPlayer *player);
+    static const char *validateSegments(const SegmentLayout &layout, uint16_t pixelCount, uint8_t &index);
+    uint8_t *acquireStreamBuffer();
+    void releaseStreamBuffer(bool show);
+    void discardStreamBuffer();
+    size_t getStreamBufferSize() const { return streamBuffer.size(); }
+    uint32_t getStreamSwitches() const { return streamSwitches; }
+    uint8_t getChannelsPerPixel() const { return led->stripHasWhite() ? 4 : 3; }
+    uint16_t getPixelCount() const { return streamBuffer.size() / getChannelsPerPixel(); }
+
+    // the setters must only be called by the task which renders (see post())
     void setEffect(Effect effect);
     void setEffectSpeed(uint8_t effectSpeed);
+    void setRainbowSpeed(uint16_t rainbowSpeed);
+    void setRainbowSpread(uint16_t rainbowSpread);
     void setTargetColor(RgbColor targetColor);
     void setTargetBrightness(uint8_t targetBrightness);
+    void setTransitionDuration(uint16_t transitionMs);
+    void setSegments(const SegmentLayout &layout);
+    bool setAnimation(AnimationPlayer *player);
 
     Effect getEffect() {
         return effect;
@@ -33,22 +153,81 @@ public:
     uint8_t getTargetBrightness() {
         return targetBrightness;
     }
+    uint16_t getTransitionDuration() {
+        return transitionMs;
+    }
+    uint16_t getRainbowSpeed() {
+        return rainbowSpeed;
+    }
+    uint16_t getRainbowSpread() {
+        return rainbowSpread;
+    }
+    const SegmentLayout& getSegments() const {
+        return segmentLayout;
+    }
+    const RenderStats& getRenderStats(Effect effect) const {
+        return renderStats[effect];
+    }
 
 private:
-    std::unique_ptr<WS2812> led;
+    StripPtr led;
     Effect effect;
     uint8_t effectSpeed;
-    RgbColor currentColor;      // refers to the first pixel (current). All other pixels are calculated from this.
-    RgbColor targetColor;       // refers to the first pixel (target). All other pixels are calculated from this.
+    RgbColor targetColor;       // color of the SOLID effect
     uint8_t currentBrightness;
     uint8_t targetBrightness;
-    bool inTransition;          // true if the currentColor is not equal to the targetColor
+    uint8_t brightnessFrom;     // brightness when the brightness fade started
+    uint16_t transitionMs;      // duration of the fades
+    StripBuffer<uint8_t, WS2812::MAX_PIXEL_BYTES> fadeFrame;    // captured by the frameFade
+    Crossfade frameFade;        // from the frame shown before the effect or color changed
+    Crossfade brightnessFade;
+    bool fadeRequested;         // the effect or the color changed, a fade starts with the next frame
+    bool brightnessFadeRequested;
     bool latestUpdateShown;
+    SpscRing<ControllerCommand, 16> commands;  // from the HTTP server task, drained at frame boundaries
+
+    void applyCommands();
+
+    uint64_t pendingStepTime;   // elapsed time which did not result in a whole step yet (us * steps per second)
+
+    RenderStats renderStats[EFFECT_COUNT];
+
+    void render(uint32_t steps, uint32_t elapsedUs);
+    void measureRender(uint32_t steps, uint32_t elapsedUs);
+    bool setEffectPixels(uint32_t steps, uint32_t elapsedUs, bool fading);
+
+    // segments, rendered instead of the effect unless the STREAM or ANIMATION effect is active
+    struct SegmentState {
+        uint16_t hue;
+        uint64_t pendingStepTime;   // like Controller::pendingStepTime with the speed of the segment
+    };
+    SegmentLayout segmentLayout;
+    SegmentState segmentStates[SegmentLayout::MAX_SEGMENTS];
+    SpscRing<SegmentLayout, 2> segmentCommands;  // from the HTTP server task, the latest is applied
+    void renderSegments(uint32_t elapsedUs, bool outdated);
+
+    // STREAM variables
+    enum StreamState : uint8_t {
+        STREAM_IDLE,            // nothing new since the last frame
+        STREAM_READY,           // a frame was uploaded and is shown with the next frame
+        STREAM_WRITING,         // owned by an uploading task
+        STREAM_READING,         // copied into the pixels by the controller
+        STREAM_TORN,            // an upload failed, not shown until a frame is complete
+    };
+    StripBuffer<uint8_t, WS2812::MAX_PIXEL_BYTES> streamBuffer;
+    volatile StreamState streamState;
+    StreamState streamBefore;   // state before the current upload
+    volatile uint32_t streamSwitches;   // an upload switched to the STREAM effect
+    bool readStreamBuffer(bool outdated);
 
-    void setEffectPixels();
+    // ANIMATION variables
+    AnimationPlayer *animation; // NULL without an animation file
+    SpscRing<AnimationPlayer *, 2> animationCommands;  // from the task which opened the file
+    bool matchesStrip(const AnimationPlayer &player) const;
+    void decodeAnimation(uint32_t elapsedUs, bool outdated);
 
     // RAINBOW variables
-    uint8_t phase;
-    int8_t sign;
-    void nextRainbowColor(uint8_t *phase, int8_t *sign, RgbColor *color, uint8_t offset);
+    uint16_t hue;               // hue of the first pixel (see hueToRgb())
+    uint16_t rainbowSpeed;      // hue step per loop
+    uint16_t rainbowSpread;     // hue step between two pixels (RAINBOW_CYCLE)
 };
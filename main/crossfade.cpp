@@ -0,0 +1,78 @@
+#include <string.h>
+#include "crossfade.hpp"
+
+/**
+ * @param frame memory for the captured frame, NULL if frameSize is 0
+ * @param frameSize bytes per frame
+ */
+Crossfade::Crossfade(uint8_t *frame, size_t frameSize) :
+    from(frame),
+    frameSize(frameSize),
+    durationUs(0),
+    elapsedUs(0),
+    weight(WEIGHT_ONE),
+    active(false)
+{
+}
+
+/**
+ * @brief Start a fade without a captured frame, only the weight is ramped.
+ * A running fade is restarted from weight 0.
+ */
+void Crossfade::start(uint32_t durationMs)
+{
+    durationUs = durationMs * 1000;
+    elapsedUs = 0;
+    weight = durationUs ? 0 : WEIGHT_ONE;
+    active = durationUs != 0;
+}
+
+/**
+ * @brief Capture the frame which is faded out and start the fade.
+ * To retarget a running fade capture the last blended frame, so there is no jump.
+ *
+ * @param frame frameSize bytes (see constructor)
+ * @param durationMs duration of the fade, 0 switches immediately
+ */
+void Crossfade::start(const uint8_t *frame, uint32_t durationMs)
+{
+    memcpy(from, frame, frameSize);
+    start(durationMs);
+}
+
+/**
+ * @brief Advance the weight by the elapsed time. The fade ends when the weight reached 0x100.
+ */
+void Crossfade::advance(uint32_t elapsedUs)
+{
+    if (!active)
+    {
+        return;
+    }
+
+    this->elapsedUs += elapsedUs;
+    if (this->elapsedUs >= durationUs)
+    {
+        weight = WEIGHT_ONE;
+        active = false;
+    }
+    else
+    {
+        weight = (uint64_t)this->elapsedUs * WEIGHT_ONE / durationUs;
+    }
+}
+
+/**
+ * @brief Blend the captured frame into the new frame (in place) with the current weight.
+ *
+ * @param frame the new frame with frameSize bytes
+ */
+void Crossfade::blendFrame(uint8_t *frame) const
+{
+    const uint16_t w = weight;
+    const uint8_t *old = from;
+    for (size_t i = 0; i < frameSize; i++)
+    {
+        frame[i] = blend(old[i], frame[i], w);
+    }
+}
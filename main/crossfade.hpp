@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Blends from a captured frame to the frames rendered afterwards over a duration.
+ *
+ * The weight of the new frame is an 8.8 fixed-point value, 0 is the captured
+ * frame and 0x100 the new frame. It grows linearly with the elapsed time, so
+ * the fade takes the requested duration independent of the color distance and
+ * the frame rate. Without a captured frame (size 0) only the weight is used,
+ * e.g. to ramp a single value with blend(). The owner provides the memory of the
+ * captured frame, so it can be a static buffer.
+ */
+class Crossfade {
+public:
+    static constexpr uint16_t WEIGHT_ONE = 0x100;
+
+    Crossfade(uint8_t *frame, size_t frameSize);
+
+    void start(uint32_t durationMs);
+    void start(const uint8_t *frame, uint32_t durationMs);
+    void advance(uint32_t elapsedUs);
+    void blendFrame(uint8_t *frame) const;
+
+    bool isActive() const { return active; }
+    uint16_t getWeight() const { return weight; }
+
+    /**
+     * @brief Blend two values with an 8.8 fixed-point weight of the second value.
+     */
+    static inline uint8_t blend(uint8_t from, uint8_t to, uint16_t weight)
+    {
+        return from + (((int16_t)to - from) * weight >> 8);
+    }
+
+private:
+    uint8_t *const from;            // captured frame
+    const size_t frameSize;
+    uint32_t durationUs;
+    uint32_t elapsedUs;
+    uint16_t weight;
+    bool active;
+};
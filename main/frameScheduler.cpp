@@ -0,0 +1,97 @@
+#include "frameScheduler.hpp"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+const char *FrameScheduler::TAG = "FrameScheduler";
+
+FrameScheduler::FrameScheduler(Controller &controller, const WS2812 &led, uint16_t targetFps) :
+    controller(controller),
+    led(led),
+    epoch(),
+    deadline(0),
+    lastFrame(0),
+    stats{0, 0, 0, 0, 0, 0}
+{
+    setTargetFps(targetFps);
+}
+
+/**
+ * @brief Set the frame rate. The frame rate is limited by the RTOS tick rate,
+ * because the scheduler sleeps at least one tick per frame.
+ */
+void FrameScheduler::setTargetFps(uint16_t targetFps)
+{
+    if (targetFps == 0)
+    {
+        targetFps = 1;
+    }
+    this->targetFps = targetFps;
+    periodCycles = F_CPU / targetFps;
+}
+
+void FrameScheduler::run()
+{
+    while (1)
+    {
+        runFrame();
+    }
+}
+
+/**
+ * @brief Sleep until the next period starts, then render one frame.
+ * If the rendering ends after the start of the following period, the deadline is
+ * missed and the periods which already passed are skipped.
+ */
+void FrameScheduler::runFrame()
+{
+    waitForDeadline();
+
+    uint64_t start = epoch.tickDiff();
+    uint32_t elapsedUs = (start - lastFrame) / CYCLES_PER_US;
+    lastFrame += (uint64_t)elapsedUs * CYCLES_PER_US;   // keep the fraction of a us for the next frame
+    controller.update(elapsedUs);
+    uint64_t end = epoch.tickDiff();
+
+    stats.frames++;
+    stats.renderUs = (end - start) / CYCLES_PER_US;
+    if (stats.renderUs > stats.maxRenderUs)
+    {
+        stats.maxRenderUs = stats.renderUs;
+    }
+    stats.transmitUs = led.getShowStats().transmitCycles / CYCLES_PER_US;
+    if (stats.transmitUs > stats.maxTransmitUs)
+    {
+        stats.maxTransmitUs = stats.transmitUs;
+    }
+
+    deadline += periodCycles;
+    if (end >= deadline)
+    {
+        stats.missedDeadlines++;
+        ESP_LOGD(TAG, "Missed the deadline by %u us", (uint32_t)((end - deadline) / CYCLES_PER_US));
+        while (deadline <= end)
+        {
+            deadline += periodCycles;
+        }
+    }
+}
+
+/**
+ * @brief Sleep the ticks up to the start of the next period, rounded to the
+ * nearest tick. A frame may start up to half a tick early, the effects advance
+ * by the measured time anyway.
+ */
+void FrameScheduler::waitForDeadline()
+{
+    uint64_t now = epoch.tickDiff();
+    if (deadline <= now)
+    {
+        return;
+    }
+
+    TickType_t ticks = (deadline - now + CYCLES_PER_TICK / 2) / CYCLES_PER_TICK;
+    if (ticks)
+    {
+        vTaskDelay(ticks);
+    }
+}
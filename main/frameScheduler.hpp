@@ -0,0 +1,49 @@
+#pragma once
+#include "controller.hpp"
+#include "rtosTimestamp.hpp"
+
+/**
+ * @brief Durations of the scheduled frames in us.
+ * A deadline is missed if a frame was rendered after the start of the next period,
+ * the periods which already passed are dropped.
+ * The transmit duration is the time the output blocked the last transmitPending().
+ */
+struct FrameSchedulerStats {
+    uint32_t frames;
+    uint32_t missedDeadlines;
+    uint32_t renderUs;
+    uint32_t maxRenderUs;
+    uint32_t transmitUs;
+    uint32_t maxTransmitUs;
+};
+
+/**
+ * @brief Renders exactly one frame per period at the target frame rate.
+ * The controller advances by the time which elapsed since the previous frame,
+ * so the animation speed does not depend on the frame rate, the CPU load or the
+ * length of the strip. The frames are transmitted by the transmitting task.
+ */
+class FrameScheduler {
+public:
+    static const char *TAG;
+    FrameScheduler(Controller &controller, const WS2812 &led, uint16_t targetFps);
+
+    void run();
+    void runFrame();
+
+    void setTargetFps(uint16_t targetFps);
+    uint16_t getTargetFps() const { return targetFps; }
+    const FrameSchedulerStats& getStats() const { return stats; }
+
+private:
+    Controller &controller;
+    const WS2812 &led;
+    uint16_t targetFps;
+    uint32_t periodCycles;
+    RtosTimestamp epoch;            // start of the scheduler, deadlines are cycles since then
+    uint64_t deadline;              // start of the next period
+    uint64_t lastFrame;             // start of the previous render
+    FrameSchedulerStats stats;
+
+    void waitForDeadline();
+};
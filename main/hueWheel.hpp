@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include "ws2812.hpp"
+
+/**
+ * @brief Fully saturated color of a 16 bit hue, 0 and 65536 are red.
+ *
+ * The wheel is split into 6 sectors. In each sector one channel is 255,
+ * one is 0 and one ramps linearly, the same path the sequential rainbow
+ * walked (red -> yellow -> green -> cyan -> blue -> magenta -> red).
+ * The color only depends on the hue, so the pixels of a frame can be
+ * computed independently from (frameHue + i * spread).
+ */
+static inline RgbColor hueToRgb(uint16_t hue)
+{
+    uint32_t scaled = (uint32_t)hue * 6;
+    uint8_t sector = scaled >> 16;
+    uint8_t up = scaled >> 8;
+    uint8_t down = 255 - up;
+
+    switch (sector)
+    {
+    case 0:
+        return RgbColor(255, up, 0);
+    case 1:
+        return RgbColor(down, 255, 0);
+    case 2:
+        return RgbColor(0, 255, up);
+    case 3:
+        return RgbColor(0, down, 255);
+    case 4:
+        return RgbColor(up, 0, 255);
+    default:
+        return RgbColor(255, 0, down);
+    }
+}
@@ -0,0 +1,63 @@
+#include "esp_log.h"
+#include "cJSON.h"
+#include "jsonArena.hpp"
+
+const char *JsonArena::TAG = "JsonArena";
+
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+
+alignas(JsonArena::ALIGNMENT) uint8_t JsonArena::arena[JsonArena::SIZE];
+size_t JsonArena::used = 0;
+size_t JsonArena::highWater = 0;
+
+/**
+ * @brief Let cJSON allocate from the arena. Must be called before the first cJSON call.
+ */
+void JsonArena::install()
+{
+    cJSON_Hooks hooks = {allocate, release};
+    cJSON_InitHooks(&hooks);
+    ESP_LOGI(TAG, "cJSON allocates from a %u byte arena", SIZE);
+}
+
+void JsonArena::reset()
+{
+    used = 0;
+}
+
+void *JsonArena::allocate(size_t size)
+{
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size > SIZE - used)
+    {
+        ESP_LOGW(TAG, "The arena is full (%u of %u bytes used, %u requested)", used, SIZE, size);
+        return NULL;
+    }
+    void *pointer = arena + used;
+    used += size;
+    if (used > highWater)
+    {
+        highWater = used;
+        ESP_LOGD(TAG, "%u bytes used", highWater);
+    }
+    return pointer;
+}
+
+/**
+ * @brief The allocations are freed together by reset().
+ */
+void JsonArena::release(void *pointer)
+{
+}
+
+#else
+
+void JsonArena::install()
+{
+}
+
+void JsonArena::reset()
+{
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+/**
+ * @brief Memory of the cJSON trees of the HTTP handlers in the static allocation mode
+ * (CONFIG_ESP_WS2812_STATIC_ALLOCATION). cJSON takes its allocations one after the other
+ * from a fixed arena, they are freed together when the Scope of the handler ends.
+ * So a request does not allocate on the heap, a tree which does not fit fails to parse
+ * or to build. Only the HTTP server task uses cJSON.
+ *
+ * Without the static allocation mode cJSON uses the heap and the Scope does nothing.
+ */
+class JsonArena {
+public:
+    static const char *TAG;
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+    static constexpr size_t SIZE = CONFIG_ESP_WS2812_JSON_ARENA_SIZE;
+#else
+    static constexpr size_t SIZE = 0;
+#endif
+
+    static void install();
+
+    /**
+     * @brief Frees the allocations of a handler when it returns.
+     */
+    class Scope {
+    public:
+        Scope() {}
+        ~Scope() { reset(); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+private:
+    static void reset();
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+    static constexpr size_t ALIGNMENT = 8;  // cJSON stores doubles
+
+    alignas(ALIGNMENT) static uint8_t arena[SIZE];
+    static size_t used;
+    static size_t highWater;
+
+    static void *allocate(size_t size);
+    static void release(void *pointer);
+#endif
+};
@@ -3,6 +3,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/timers.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_netif.h"
@@ -13,10 +14,16 @@
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
-#include "ws2812.hpp"
+#include "FixedOrderWS2812.hpp"
 #include <cstring>
-#include "server.cpp"
-#include "controller.cpp"
+#include "server.hpp"
+#include "controller.hpp"
+#include "frameScheduler.hpp"
+#include "realtimeReceiver.hpp"
+#include "udpListener.hpp"
+#include "metrics.hpp"
+#include "animationPlayer.hpp"
+#include "stateStore.hpp"
 
 #include <stdio.h>
 #include <string.h>
@@ -24,34 +31,93 @@
 #include <sys/stat.h>
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #define GPIO_LED_STRIP CONFIG_ESP_WS2812_PIN
 #define NUM_LEDS CONFIG_ESP_WS2812_NUM_LED
+#define TARGET_FPS CONFIG_ESP_WS2812_TARGET_FPS
+#define E131_UNIVERSE CONFIG_ESP_WS2812_E131_UNIVERSE
+#define ANIMATION_FILE "/spiffs/animation.npa"
 #define EXAMPLE_ESP_WIFI_SSID CONFIG_ESP_WIFI_SSID
 #define EXAMPLE_ESP_WIFI_PASS CONFIG_ESP_WIFI_PASSWORD
-#define EXAMPLE_ESP_MAXIMUM_RETRY 5
+#define EXAMPLE_ESP_MAXIMUM_RETRY CONFIG_ESP_MAXIMUM_RETRY
+#define STATE_SAVE_DELAY_MS CONFIG_ESP_WS2812_STATE_SAVE_DELAY_MS
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
+#define MAX_RECONNECT_DELAY_MS 60000
 
 static const char *TAG = "wifi station";
 
+/**
+ * Create one of the objects which live as long as the firmware runs, they are never destroyed.
+ * With CONFIG_ESP_WS2812_STATIC_ALLOCATION each type gets its storage in .bss, so the RAM of
+ * the buffers inside the objects is known at link time (see the RAM budget of the build).
+ */
+template <typename T, typename... Args>
+static T *create(Args &&...args)
+{
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+    alignas(T) static uint8_t storage[sizeof(T)];
+    return new (storage) T(std::forward<Args>(args)...);
+#else
+    return new T(std::forward<Args>(args)...);
+#endif
+}
+
+// whether the objects of create() may be deleted
+#ifdef CONFIG_ESP_WS2812_STATIC_ALLOCATION
+static constexpr bool CREATED_ON_HEAP = false;
+#else
+static constexpr bool CREATED_ON_HEAP = true;
+#endif
+
+/**
+ * Renders one frame per period of the target frame rate (see FrameScheduler).
+ */
 void controllerTask(void *parameter)
 {
-    auto ctrlPtr = static_cast<Controller *>(parameter);
+    auto scheduler = static_cast<FrameScheduler *>(parameter);
+    scheduler->run();
+}
+
+/**
+ * Sends the frames presented by the controllerTask. The wire buffers are
+ * swapped at the latch point, so the next frame can be rendered while the
+ * current one is transmitted.
+ */
+void transmitTask(void *parameter)
+{
+    auto ledPtr = static_cast<WS2812 *>(parameter);
+    bool firstLight = true;
 
     while (1)
     {
-        for (uint8_t i = 0; i < ctrlPtr->getEffectSpeed(); i++)
+        if (!ledPtr->waitForFrame(portMAX_DELAY))
         {
-            ctrlPtr->loop();
+            continue;
+        }
+        while (!ledPtr->isReady())
+        {
+            vTaskDelay(1);
+        }
+        ledPtr->transmitPending();
+
+        if (firstLight)
+        {
+            ESP_LOGI(TAG, "First light %lld ms after boot", esp_timer_get_time() / 1000);
+            firstLight = false;
         }
-        vTaskDelay(1);
     }
 }
 
 
 static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_num = 0;
+static TimerHandle_t s_reconnect_timer;
+
+static void reconnect_timer_callback(TimerHandle_t timer)
+{
+    esp_wifi_connect();
+}
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data)
@@ -69,6 +135,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
             esp_wifi_set_protocol(ESP_IF_WIFI_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
         }
         
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         if (s_retry_num++ < EXAMPLE_ESP_MAXIMUM_RETRY)
         {
             esp_wifi_connect();
@@ -76,7 +143,11 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         }
         else
         {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            // the strip keeps running, the retries continue with a growing delay
+            uint32_t shift = s_retry_num - EXAMPLE_ESP_MAXIMUM_RETRY;
+            uint32_t delayMs = shift < 6 ? 1000 << shift : MAX_RECONNECT_DELAY_MS;
+            xTimerChangePeriod(s_reconnect_timer, pdMS_TO_TICKS(delayMs), 0);
+            ESP_LOGI(TAG, "retry to connect to the AP in %u ms", delayMs);
         }
         ESP_LOGI(TAG, "connect to the AP fail");
     } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
@@ -92,8 +163,8 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
     if (event_id == IP_EVENT_STA_GOT_IP)
     {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:%s",
-                 ip4addr_ntoa(&event->ip_info.ip));
+        ESP_LOGI(TAG, "got ip:%s %lld ms after boot",
+                 ip4addr_ntoa(&event->ip_info.ip), esp_timer_get_time() / 1000);
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     } else {
@@ -113,9 +184,14 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     }
 }
 
+/**
+ * Start connecting to the AP, does not wait for the connection. The event handler
+ * reconnects after a disconnect, WIFI_CONNECTED_BIT is set while there is an IP address.
+ */
 void wifi_init_sta(void)
 {
     s_wifi_event_group = xEventGroupCreate();
+    s_reconnect_timer = xTimerCreate("wifiReconnect", pdMS_TO_TICKS(1000), pdFALSE, NULL, reconnect_timer_callback);
 
     tcpip_adapter_init();
 
@@ -148,35 +224,6 @@ void wifi_init_sta(void)
     ESP_ERROR_CHECK(esp_wifi_start());
 
     ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT)
-    {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    }
-    else if (bits & WIFI_FAIL_BIT)
-    {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    }
-    else
-    {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-    }
-
-    ESP_ERROR_CHECK(esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler));
-    ESP_ERROR_CHECK(esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler));
-    vEventGroupDelete(s_wifi_event_group);
 }
 
 extern "C" void app_main()
@@ -186,17 +233,79 @@ extern "C" void app_main()
     ESP_LOGI(TAG, "Rate tick %d", portTICK_RATE_MS);
     ESP_ERROR_CHECK(nvs_flash_init());
 
+    // the strip shows the stored state before the network is up
+    auto output = std::make_unique<BitBangOutput>((gpio_num_t) GPIO_LED_STRIP);
+#ifdef CONFIG_ESP_WS2812_INTERRUPTIBLE
+    // the WiFi interrupts run between the pixels instead of waiting for the whole frame
+    output->setInterruptible(PixelLayout<PixelOrder::GRB>::channels * 8, CONFIG_ESP_WS2812_MAX_GAP_US);
+#endif
+    // the controller owns the strip, its deleter knows if it is in static storage
+    StripPtr ledPtr(create<FixedOrderWS2812<PixelOrder::GRB>>(std::move(output), NUM_LEDS), StripDeleter(CREATED_ON_HEAP));
+    auto led = ledPtr.get();
+#ifdef CONFIG_ESP_WS2812_GAMMA_CORRECTION
+    led->setGammaCorrection(true);
+#endif
+    auto ctrlPtr = create<Controller>(std::move(ledPtr));
+    auto stateStore = create<StateStore>(STATE_SAVE_DELAY_MS);
+    stateStore->restore(*ctrlPtr);
+    auto metrics = create<Metrics>(*ctrlPtr, *led);
+    auto scheduler = create<FrameScheduler>(*ctrlPtr, *led, TARGET_FPS);
+    metrics->setScheduler(scheduler);
+
+    TaskHandle_t task;
+    if (xTaskCreate(transmitTask, "transmitTask", 2048, led, 6, &task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create transmit task");
+    }
+    else
+    {
+        metrics->addTask("transmitTask", task);
+    }
+
+    if (xTaskCreate(controllerTask, "controllerTask", 4096, scheduler, 5, &task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create controller task");
+    }
+    else
+    {
+        metrics->addTask("controllerTask", task);
+    }
+
     ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
     wifi_init_sta();
 
+    // the server listens on all interfaces, it is reachable as soon as the station got an address
+    auto server = create<Server>(*ctrlPtr, *metrics, stateStore);
+    if (!stateStore->start(2))
+    {
+        ESP_LOGE(TAG, "Failed to start the state store, changes are not kept across a reboot");
+    }
 
-    auto ledPtr = std::make_unique<WS2812>((gpio_num_t) GPIO_LED_STRIP, NUM_LEDS, PixelOrder::GRB);
-    auto ctrlPtr = new Controller(std::move(ledPtr));
-    auto server = new Server(*ctrlPtr);   
-
-    if (xTaskCreate(controllerTask, "controllerTask", 4096, ctrlPtr, 5, NULL) != pdPASS)
+    // the server mounted the SPIFFS partition, the reader task runs below the controllerTask.
+    // The player is deleted if there is no animation, it is not in static storage.
+    auto animation = new AnimationPlayer();
+    if (animation->open(ANIMATION_FILE, 4) && ctrlPtr->postAnimation(animation))
     {
-        ESP_LOGE(TAG, "Failed to create controller task");
+        metrics->setAnimation(animation);
+    }
+    else
+    {
+        delete animation;
     }
 
-}
\ No newline at end of file
+    auto receiver = create<RealtimeReceiver>(*ctrlPtr, E131_UNIVERSE);
+    auto listener = create<UdpListener>(*receiver);
+    metrics->setReceiver(receiver);
+    ESP_LOGI(TAG, "Free heap after init: %u bytes", esp_get_free_heap_size());
+
+    // the multicast groups of E1.31 are joined on the interface of the station
+    xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    if (!listener->start(5))
+    {
+        ESP_LOGE(TAG, "Failed to start the UDP listener");
+    }
+    else
+    {
+        metrics->addTask("udpListener", listener->getTask());
+    }
+}
@@ -0,0 +1,301 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_system.h"
+#include "metrics.hpp"
+
+static const char *effectNames[EFFECT_COUNT] = {"solid", "rainbow", "rainbow_cycle", "stream", "animation"};
+static const char *handlerNames[Metrics::HANDLER_COUNT] = {"status", "color", "frame", "ws", "asset", "metrics", "segments", "pixels"};
+
+const uint32_t LatencyHistogram::BOUNDS_US[BOUND_COUNT] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000};
+
+void LatencyHistogram::record(uint32_t us)
+{
+    uint8_t bucket = 0;
+    while (bucket < BOUND_COUNT && us > BOUNDS_US[bucket])
+    {
+        bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    sumUs += us;
+    if (us > maxUs)
+    {
+        maxUs = us;
+    }
+}
+
+MetricsWriter::MetricsWriter(Flush flush, void *context) :
+    flushFunction(flush),
+    context(context),
+    failed(false),
+    length(0)
+{
+}
+
+/**
+ * @brief Append formatted text, a single print must fit into the buffer.
+ */
+void MetricsWriter::print(const char *format, ...)
+{
+    for (uint8_t attempt = 0; attempt < 2 && !failed; attempt++)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer + length, sizeof(buffer) - length, format, args);
+        va_end(args);
+
+        if (written >= 0 && (size_t)written < sizeof(buffer) - length)
+        {
+            length += written;
+            return;
+        }
+        // flush and format again into the empty buffer
+        flush();
+    }
+    failed = true;
+}
+
+/**
+ * @brief Flush the rest of the buffer.
+ * @return false if a flush failed or a print did not fit into the buffer
+ */
+bool MetricsWriter::finish()
+{
+    flush();
+    return !failed;
+}
+
+void MetricsWriter::flush()
+{
+    if (length && !failed && !flushFunction(context, buffer, length))
+    {
+        failed = true;
+    }
+    length = 0;
+}
+
+Metrics::Metrics(const Controller &controller, const WS2812 &led) :
+    controller(controller),
+    led(led),
+    scheduler(nullptr),
+    receiver(nullptr),
+    animation(nullptr),
+    requests{},
+    tasks{},
+    taskCount(0)
+{
+}
+
+/**
+ * @brief Report the stack high-water mark of the task. A task is only added once.
+ * May be called by any task, the entry is complete before the count includes it.
+ * @return false if the task list is full
+ */
+bool Metrics::addTask(const char *name, TaskHandle_t task)
+{
+    if (task == NULL)
+    {
+        return false;
+    }
+
+    bool added = true;
+    taskENTER_CRITICAL();
+    uint8_t i = 0;
+    while (i < taskCount && tasks[i].handle != task)
+    {
+        i++;
+    }
+    if (i == MAX_TASKS)
+    {
+        added = false;
+    }
+    else if (i == taskCount)
+    {
+        tasks[i] = {name, task};
+        taskCount++;
+    }
+    taskEXIT_CRITICAL();
+    return added;
+}
+
+void Metrics::writePrometheus(MetricsWriter &writer) const
+{
+    const FrameCounters &frames = led.getFrameCounters();
+    const ShowStats &show = led.getShowStats();
+    const CriticalStats &critical = led.getCriticalStats();
+    writer.print("# TYPE ws2812_frames_total counter\n"
+                 "ws2812_frames_total{result=\"presented\"} %u\n"
+                 "ws2812_frames_total{result=\"skipped\"} %u\n"
+                 "ws2812_frames_total{result=\"transmitted\"} %u\n",
+                 frames.framesPresented, frames.framesSkipped, frames.framesTransmitted);
+    writer.print("# TYPE ws2812_bytes_saved_total counter\nws2812_bytes_saved_total %llu\n",
+                 (unsigned long long)frames.bytesSaved);
+    writer.print("# HELP ws2812_transmit_cycles_total CPU cycles the output blocked (bit-bang: interrupts disabled)\n"
+                 "# TYPE ws2812_transmit_cycles_total counter\nws2812_transmit_cycles_total %llu\n",
+                 (unsigned long long)show.totalTransmitCycles);
+    writer.print("# TYPE ws2812_transmit_cycles_max gauge\nws2812_transmit_cycles_max %u\n", show.maxTransmitCycles);
+    writer.print("# HELP ws2812_interrupts_off_cycles_max Longest window with disabled interrupts of a transmission\n"
+                 "# TYPE ws2812_interrupts_off_cycles_max gauge\nws2812_interrupts_off_cycles_max %u\n",
+                 critical.maxCycles);
+    writer.print("# HELP ws2812_gap_overflows_total Frames sent again because an interrupt delayed a bit too long\n"
+                 "# TYPE ws2812_gap_overflows_total counter\nws2812_gap_overflows_total %u\n",
+                 critical.gapOverflows);
+    writer.print("# TYPE ws2812_interrupts_off_fallbacks_total counter\nws2812_interrupts_off_fallbacks_total %u\n",
+                 critical.fallbacks);
+    writer.print("# TYPE ws2812_encode_cycles gauge\nws2812_encode_cycles %u\n", show.encodeCycles);
+
+    writer.print("# TYPE controller_render_frames_total counter\n");
+    for (uint8_t effect = 0; effect < EFFECT_COUNT; effect++)
+    {
+        writer.print("controller_render_frames_total{effect=\"%s\"} %u\n", effectNames[effect],
+                     controller.getRenderStats((Effect)effect).frames);
+    }
+    writer.print("# TYPE controller_render_microseconds_total counter\n");
+    for (uint8_t effect = 0; effect < EFFECT_COUNT; effect++)
+    {
+        writer.print("controller_render_microseconds_total{effect=\"%s\"} %llu\n", effectNames[effect],
+                     (unsigned long long)controller.getRenderStats((Effect)effect).totalUs);
+    }
+    writer.print("# TYPE controller_render_microseconds_max gauge\n");
+    for (uint8_t effect = 0; effect < EFFECT_COUNT; effect++)
+    {
+        writer.print("controller_render_microseconds_max{effect=\"%s\"} %u\n", effectNames[effect],
+                     controller.getRenderStats((Effect)effect).maxUs);
+    }
+
+    if (scheduler)
+    {
+        const FrameSchedulerStats &stats = scheduler->getStats();
+        writer.print("# TYPE scheduler_frames_total counter\nscheduler_frames_total %u\n", stats.frames);
+        writer.print("# TYPE scheduler_missed_deadlines_total counter\nscheduler_missed_deadlines_total %u\n",
+                     stats.missedDeadlines);
+        writer.print("# TYPE scheduler_render_microseconds_max gauge\nscheduler_render_microseconds_max %u\n",
+                     stats.maxRenderUs);
+    }
+
+    if (receiver)
+    {
+        const RealtimeCounters &counters = receiver->getCounters();
+        writer.print("# TYPE realtime_packets_total counter\n"
+                     "realtime_packets_total{result=\"received\"} %u\n"
+                     "realtime_packets_total{result=\"late\"} %u\n"
+                     "realtime_packets_total{result=\"dropped\"} %u\n"
+                     "realtime_packets_total{result=\"shown\"} %u\n",
+                     counters.received, counters.late, counters.dropped, counters.shown);
+    }
+
+    if (animation)
+    {
+        const AnimationStats &stats = animation->getStats();
+        writer.print("# TYPE animation_frames_total counter\nanimation_frames_total %u\n"
+                     "# TYPE animation_decode_microseconds_total counter\nanimation_decode_microseconds_total %llu\n"
+                     "# TYPE animation_decode_microseconds_max gauge\nanimation_decode_microseconds_max %u\n",
+                     stats.frames, (unsigned long long)stats.totalDecodeUs, stats.maxDecodeUs);
+        writer.print("# TYPE animation_read_bytes_total counter\nanimation_read_bytes_total %llu\n"
+                     "# TYPE animation_read_microseconds_total counter\nanimation_read_microseconds_total %llu\n"
+                     "# TYPE animation_underruns_total counter\nanimation_underruns_total %u\n",
+                     (unsigned long long)stats.bytesRead, (unsigned long long)stats.readUs, stats.underruns);
+    }
+
+    writer.print("# TYPE http_request_duration_seconds histogram\n");
+    for (uint8_t handler = 0; handler < HANDLER_COUNT; handler++)
+    {
+        const LatencyHistogram &histogram = requests[handler];
+        uint32_t cumulative = 0;
+        for (uint8_t bucket = 0; bucket < LatencyHistogram::BOUND_COUNT; bucket++)
+        {
+            cumulative += histogram.buckets[bucket];
+            writer.print("http_request_duration_seconds_bucket{handler=\"%s\",le=\"%u.%06u\"} %u\n", handlerNames[handler],
+                         LatencyHistogram::BOUNDS_US[bucket] / 1000000, LatencyHistogram::BOUNDS_US[bucket] % 1000000, cumulative);
+        }
+        writer.print("http_request_duration_seconds_bucket{handler=\"%s\",le=\"+Inf\"} %u\n"
+                     "http_request_duration_seconds_sum{handler=\"%s\"} %llu.%06u\n"
+                     "http_request_duration_seconds_count{handler=\"%s\"} %u\n",
+                     handlerNames[handler], histogram.count,
+                     handlerNames[handler], (unsigned long long)(histogram.sumUs / 1000000), (uint32_t)(histogram.sumUs % 1000000),
+                     handlerNames[handler], histogram.count);
+    }
+
+    writer.print("# TYPE heap_free_bytes gauge\nheap_free_bytes %u\n"
+                 "# TYPE heap_min_free_bytes gauge\nheap_min_free_bytes %u\n",
+                 (uint32_t)esp_get_free_heap_size(), (uint32_t)esp_get_minimum_free_heap_size());
+
+    writer.print("# HELP task_stack_high_water_mark Minimum free stack (uxTaskGetStackHighWaterMark)\n"
+                 "# TYPE task_stack_high_water_mark gauge\n");
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        writer.print("task_stack_high_water_mark{task=\"%s\"} %u\n", tasks[i].name,
+                     (uint32_t)uxTaskGetStackHighWaterMark(tasks[i].handle));
+    }
+}
+
+void Metrics::writeJson(MetricsWriter &writer) const
+{
+    const FrameCounters &frames = led.getFrameCounters();
+    const ShowStats &show = led.getShowStats();
+    const CriticalStats &critical = led.getCriticalStats();
+    writer.print("{\"strip\":{\"presented\":%u,\"skipped\":%u,\"transmitted\":%u,\"bytesSaved\":%llu,"
+                 "\"transmitCycles\":%llu,\"maxTransmitCycles\":%u,\"encodeCycles\":%u,",
+                 frames.framesPresented, frames.framesSkipped, frames.framesTransmitted, (unsigned long long)frames.bytesSaved,
+                 (unsigned long long)show.totalTransmitCycles, show.maxTransmitCycles, show.encodeCycles);
+    writer.print("\"maxInterruptsOffCycles\":%u,\"gapOverflows\":%u,\"interruptsOffFallbacks\":%u},",
+                 critical.maxCycles, critical.gapOverflows, critical.fallbacks);
+
+    writer.print("\"render\":{");
+    for (uint8_t effect = 0; effect < EFFECT_COUNT; effect++)
+    {
+        const RenderStats &stats = controller.getRenderStats((Effect)effect);
+        writer.print("%s\"%s\":{\"frames\":%u,\"avgUs\":%u,\"maxUs\":%u}", effect ? "," : "", effectNames[effect],
+                     stats.frames, stats.frames ? (uint32_t)(stats.totalUs / stats.frames) : 0, stats.maxUs);
+    }
+    writer.print("},");
+
+    if (scheduler)
+    {
+        const FrameSchedulerStats &stats = scheduler->getStats();
+        writer.print("\"scheduler\":{\"frames\":%u,\"missedDeadlines\":%u,\"maxRenderUs\":%u,\"maxTransmitUs\":%u},",
+                     stats.frames, stats.missedDeadlines, stats.maxRenderUs, stats.maxTransmitUs);
+    }
+
+    if (receiver)
+    {
+        const RealtimeCounters &counters = receiver->getCounters();
+        writer.print("\"realtime\":{\"received\":%u,\"late\":%u,\"dropped\":%u,\"shown\":%u},",
+                     counters.received, counters.late, counters.dropped, counters.shown);
+    }
+
+    if (animation)
+    {
+        // the read throughput in bytes per second of fread() time
+        const AnimationStats &stats = animation->getStats();
+        writer.print("\"animation\":{\"frames\":%u,\"avgDecodeUs\":%u,\"maxDecodeUs\":%u,\"bytesRead\":%llu,"
+                     "\"readBytesPerSecond\":%u,\"underruns\":%u,\"loops\":%u},",
+                     stats.frames, stats.frames ? (uint32_t)(stats.totalDecodeUs / stats.frames) : 0, stats.maxDecodeUs,
+                     (unsigned long long)stats.bytesRead, stats.readUs ? (uint32_t)(stats.bytesRead * 1000000 / stats.readUs) : 0,
+                     stats.underruns, stats.loops);
+    }
+
+    // the buckets are not cumulative, their bounds are the le labels of the Prometheus format
+    writer.print("\"http\":{");
+    for (uint8_t handler = 0; handler < HANDLER_COUNT; handler++)
+    {
+        const LatencyHistogram &histogram = requests[handler];
+        writer.print("%s\"%s\":{\"count\":%u,\"avgUs\":%u,\"maxUs\":%u,\"buckets\":[", handler ? "," : "", handlerNames[handler],
+                     histogram.count, histogram.count ? (uint32_t)(histogram.sumUs / histogram.count) : 0, histogram.maxUs);
+        for (uint8_t bucket = 0; bucket <= LatencyHistogram::BOUND_COUNT; bucket++)
+        {
+            writer.print("%s%u", bucket ? "," : "", histogram.buckets[bucket]);
+        }
+        writer.print("]}");
+    }
+    writer.print("},");
+
+    writer.print("\"heap\":{\"free\":%u,\"minFree\":%u},\"stacks\":{",
+                 (uint32_t)esp_get_free_heap_size(), (uint32_t)esp_get_minimum_free_heap_size());
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        writer.print("%s\"%s\":%u", i ? "," : "", tasks[i].name, (uint32_t)uxTaskGetStackHighWaterMark(tasks[i].handle));
+    }
+    writer.print("}}");
+}
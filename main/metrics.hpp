@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "controller.hpp"
+#include "frameScheduler.hpp"
+#include "realtimeReceiver.hpp"
+
+/**
+ * @brief Histogram of request durations. The buckets are not cumulative,
+ * the last one counts the durations above the last bound.
+ */
+struct LatencyHistogram {
+    static constexpr uint8_t BOUND_COUNT = 8;
+    static const uint32_t BOUNDS_US[BOUND_COUNT];
+
+    uint32_t buckets[BOUND_COUNT + 1];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+
+    void record(uint32_t us);
+};
+
+/**
+ * @brief Formats text into a small buffer, which is passed to the flush function
+ * whenever it is full (e.g. as a chunk of the HTTP response).
+ */
+class MetricsWriter {
+public:
+    typedef bool (*Flush)(void *context, const char *data, size_t length);
+
+    MetricsWriter(Flush flush, void *context);
+
+    void print(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    bool finish();
+
+private:
+    Flush flushFunction;
+    void *context;
+    bool failed;
+    size_t length;
+    char buffer[256];
+
+    void flush();
+};
+
+/**
+ * @brief Collects the counters of the strip, the controller, the scheduler, the realtime
+ * receiver and the HTTP handlers and formats them in the Prometheus text format or as JSON.
+ *
+ * The counters are written by their tasks without locking and read while they are
+ * formatted, a 64 bit sum may be torn by a concurrent update.
+ * recordRequest() must only be called by the HTTP server task, addTask() by any task.
+ */
+class Metrics {
+public:
+    enum Handler : uint8_t {
+        HANDLER_STATUS = 0,
+        HANDLER_COLOR,
+        HANDLER_FRAME,
+        HANDLER_WS,
+        HANDLER_ASSET,
+        HANDLER_METRICS,
+        HANDLER_SEGMENTS,
+        HANDLER_PIXELS,
+        HANDLER_COUNT,
+    };
+    static constexpr uint8_t MAX_TASKS = 8;
+
+    Metrics(const Controller &controller, const WS2812 &led);
+
+    void setScheduler(const FrameScheduler *scheduler) { this->scheduler = scheduler; }
+    void setReceiver(const RealtimeReceiver *receiver) { this->receiver = receiver; }
+    void setAnimation(const AnimationPlayer *animation) { this->animation = animation; }
+    bool addTask(const char *name, TaskHandle_t task);
+    void recordRequest(Handler handler, uint32_t us) { requests[handler].record(us); }
+
+    void writePrometheus(MetricsWriter &writer) const;
+    void writeJson(MetricsWriter &writer) const;
+
+private:
+    struct Task {
+        const char *name;
+        TaskHandle_t handle;
+    };
+
+    const Controller &controller;
+    const WS2812 &led;
+    const FrameScheduler *scheduler;
+    const RealtimeReceiver *receiver;
+    const AnimationPlayer *animation;
+    LatencyHistogram requests[HANDLER_COUNT];
+    Task tasks[MAX_TASKS];
+    uint8_t taskCount;
+};
+
+/**
+ * @brief Records the lifetime of the object as the duration of a request.
+ */
+class RequestTimer {
+public:
+    RequestTimer(Metrics &metrics, Metrics::Handler handler) :
+        metrics(metrics), handler(handler), start(esp_timer_get_time()) {}
+    ~RequestTimer() { metrics.recordRequest(handler, esp_timer_get_time() - start); }
+
+private:
+    Metrics &metrics;
+    const Metrics::Handler handler;
+    const int64_t start;
+};
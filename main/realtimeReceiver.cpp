@@ -0,0 +1,230 @@
+#include <string.h>
+#include "realtimeReceiver.hpp"
+
+#define DDP_HEADER_LENGTH           10
+#define DDP_TIMECODE_LENGTH         4
+#define DDP_VERSION_MASK            0xc0
+#define DDP_VERSION_1               0x40
+#define DDP_FLAG_TIMECODE           0x10
+#define DDP_FLAG_STORAGE            0x08
+#define DDP_FLAG_REPLY              0x04
+#define DDP_FLAG_QUERY              0x02
+#define DDP_FLAG_PUSH               0x01
+#define DDP_ID_DISPLAY              1
+#define DDP_ID_ALL                  255
+
+#define E131_DATA_OFFSET            126     // first DMX channel after the start code
+#define E131_SYNC_LENGTH            49
+#define E131_ROOT_VECTOR_DATA       0x00000004
+#define E131_ROOT_VECTOR_EXTENDED   0x00000008
+#define E131_FRAMING_VECTOR_DATA    0x00000002
+#define E131_FRAMING_VECTOR_SYNC    0x00000001
+#define E131_DMP_VECTOR             0x02
+#define E131_DMP_ADDRESS_TYPE       0xa1
+#define E131_OPTION_PREVIEW         0x80
+#define E131_OPTION_TERMINATED      0x40
+#define E131_UNIVERSE_CHANNELS      512
+
+static const uint8_t acnPacketIdentifier[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+static inline uint16_t be16(const uint8_t *data)
+{
+    return (uint16_t)data[0] << 8 | data[1];
+}
+
+static inline uint32_t be32(const uint8_t *data)
+{
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+const char *RealtimeReceiver::TAG = "RealtimeReceiver";
+
+RealtimeReceiver::RealtimeReceiver(Controller &controller, uint16_t firstUniverse) :
+    controller(controller),
+    firstUniverse(firstUniverse),
+    channelsPerUniverse(E131_UNIVERSE_CHANNELS / controller.getChannelsPerPixel() * controller.getChannelsPerPixel()),
+    ddpSequence(0),
+    universeSequence((controller.getStreamBufferSize() + channelsPerUniverse - 1) / channelsPerUniverse, -1),
+    syncSequence(-1),
+    syncAddress(0),
+    counters{0, 0, 0, 0}
+{
+}
+
+/**
+ * @brief Handle a DDP packet. Queries, replies and packets for the storage or other
+ * destinations are not supported and dropped. The sequence number (1 - 15, 0 if unused)
+ * is stale if it is equal to the last one or up to 7 numbers behind it.
+ */
+void RealtimeReceiver::handleDdp(const uint8_t *packet, size_t length)
+{
+    if (length < DDP_HEADER_LENGTH || (packet[0] & DDP_VERSION_MASK) != DDP_VERSION_1)
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const uint8_t flags = packet[0];
+    const uint8_t id = packet[3];
+    if (flags & (DDP_FLAG_STORAGE | DDP_FLAG_REPLY | DDP_FLAG_QUERY) || (id != DDP_ID_DISPLAY && id != DDP_ID_ALL))
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const size_t header = DDP_HEADER_LENGTH + (flags & DDP_FLAG_TIMECODE ? DDP_TIMECODE_LENGTH : 0);
+    const uint32_t offset = be32(packet + 4);
+    const uint16_t dataLength = be16(packet + 8);
+    if (length < header + dataLength)
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const uint8_t sequence = packet[1] & 0x0f;
+    if (sequence && ddpSequence)
+    {
+        uint8_t ahead = (sequence - ddpSequence + 15) % 15;
+        if (ahead == 0 || ahead > 7)
+        {
+            counters.late++;
+            return;
+        }
+    }
+
+    if (write(offset, packet + header, dataLength, flags & DDP_FLAG_PUSH))
+    {
+        ddpSequence = sequence;
+    }
+}
+
+/**
+ * @brief Handle an E1.31 data or synchronization packet. The sequence numbers are
+ * tracked per universe, a packet is stale if it is up to 20 numbers behind the last one
+ * (see ANSI E1.31-2018, 6.7.2). Preview data is ignored.
+ */
+void RealtimeReceiver::handleE131(const uint8_t *packet, size_t length)
+{
+    if (length < E131_SYNC_LENGTH || be16(packet) != 0x0010 || memcmp(packet + 4, acnPacketIdentifier, sizeof(acnPacketIdentifier)))
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const uint32_t rootVector = be32(packet + 18);
+    if (rootVector == E131_ROOT_VECTOR_EXTENDED)
+    {
+        handleE131Sync(packet, length);
+        return;
+    }
+
+    if (rootVector != E131_ROOT_VECTOR_DATA || length <= E131_DATA_OFFSET ||
+        be32(packet + 40) != E131_FRAMING_VECTOR_DATA ||
+        packet[117] != E131_DMP_VECTOR || packet[118] != E131_DMP_ADDRESS_TYPE)
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const uint8_t options = packet[112];
+    const uint16_t universe = be16(packet + 113);
+    const uint16_t valueCount = be16(packet + 123);
+    if (options & E131_OPTION_PREVIEW || universe < firstUniverse || (size_t)(universe - firstUniverse) >= universeSequence.size() ||
+        valueCount < 1 || length < (size_t)E131_DATA_OFFSET - 1 + valueCount || packet[125] != 0)
+    {
+        counters.dropped++;
+        return;
+    }
+
+    int16_t &last = universeSequence[universe - firstUniverse];
+    if (options & E131_OPTION_TERMINATED)
+    {
+        // the source stopped, the next source starts with any sequence number
+        last = -1;
+        counters.received++;
+        return;
+    }
+
+    const uint8_t sequence = packet[111];
+    if (isStaleE131(last, sequence))
+    {
+        counters.late++;
+        return;
+    }
+
+    const size_t channels = valueCount - 1;
+    const uint16_t sync = be16(packet + 109);
+    if (write((universe - firstUniverse) * channelsPerUniverse, packet + E131_DATA_OFFSET,
+              channels < channelsPerUniverse ? channels : channelsPerUniverse, sync == 0))
+    {
+        last = sequence;
+        syncAddress = sync;
+    }
+}
+
+void RealtimeReceiver::handleE131Sync(const uint8_t *packet, size_t length)
+{
+    if (length < E131_SYNC_LENGTH || be32(packet + 40) != E131_FRAMING_VECTOR_SYNC || syncAddress == 0 ||
+        be16(packet + 45) != syncAddress)
+    {
+        counters.dropped++;
+        return;
+    }
+
+    const uint8_t sequence = packet[44];
+    if (isStaleE131(syncSequence, sequence))
+    {
+        counters.late++;
+        return;
+    }
+
+    if (write(0, nullptr, 0, true))
+    {
+        syncSequence = sequence;
+    }
+}
+
+bool RealtimeReceiver::isStaleE131(int16_t last, uint8_t sequence)
+{
+    if (last < 0)
+    {
+        return false;
+    }
+    int8_t ahead = (int8_t)(sequence - (uint8_t)last);
+    return ahead <= 0 && ahead > -20;
+}
+
+/**
+ * @brief Copy the data into the stream buffer, the part behind the strip is ignored.
+ *
+ * @param show the frame is complete
+ * @return false if the packet was dropped
+ */
+bool RealtimeReceiver::write(size_t offset, const uint8_t *data, size_t length, bool show)
+{
+    const size_t size = controller.getStreamBufferSize();
+    if (length && offset >= size)
+    {
+        counters.dropped++;
+        return false;
+    }
+
+    uint8_t *buffer = controller.acquireStreamBuffer();
+    if (buffer == nullptr)
+    {
+        counters.dropped++;
+        return false;
+    }
+    if (length)
+    {
+        memcpy(buffer + offset, data, length < size - offset ? length : size - offset);
+    }
+    controller.releaseStreamBuffer(show);
+
+    counters.received++;
+    if (show)
+    {
+        counters.shown++;
+    }
+    return true;
+}
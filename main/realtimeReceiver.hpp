@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "controller.hpp"
+
+/**
+ * @brief Counters of the realtime packets since the start.
+ * late: dropped because the sequence number was older than the last one
+ * dropped: malformed, not for this device, out of range or the stream buffer was busy
+ * shown: frames completed by a DDP push or an E1.31 packet / synchronization
+ */
+struct RealtimeCounters {
+    uint32_t received;
+    uint32_t late;
+    uint32_t dropped;
+    uint32_t shown;
+};
+
+/**
+ * @brief Decodes DDP and E1.31 (sACN) packets into the stream buffer of the controller.
+ *
+ * DDP: the data offset is the byte offset in the strip (R, G, B (, W) per pixel),
+ * the frame is shown when the push flag is set.
+ * E1.31: each universe holds 170 RGB or 128 RGBW pixels, starting with firstUniverse.
+ * Without a synchronization address the frame is shown with every data packet,
+ * otherwise when the synchronization packet arrives.
+ *
+ * The functions are called by one task (see UdpListener), they never block.
+ */
+class RealtimeReceiver {
+public:
+    static const char *TAG;
+    static constexpr uint16_t DDP_PORT = 4048;
+    static constexpr uint16_t E131_PORT = 5568;
+
+    RealtimeReceiver(Controller &controller, uint16_t firstUniverse);
+
+    void handleDdp(const uint8_t *packet, size_t length);
+    void handleE131(const uint8_t *packet, size_t length);
+
+    uint16_t getFirstUniverse() const { return firstUniverse; }
+    uint16_t getUniverseCount() const { return universeSequence.size(); }
+    const RealtimeCounters& getCounters() const { return counters; }
+
+private:
+    Controller &controller;
+    const uint16_t firstUniverse;
+    const size_t channelsPerUniverse;
+    uint8_t ddpSequence;                    // 0 if unknown
+    std::vector<int16_t> universeSequence;  // -1 if unknown
+    int16_t syncSequence;
+    uint16_t syncAddress;                   // synchronization universe of the data packets, 0 if unsynchronized
+    RealtimeCounters counters;
+
+    void handleE131Sync(const uint8_t *packet, size_t length);
+    bool write(size_t offset, const uint8_t *data, size_t length, bool show);
+    static bool isStaleE131(int16_t last, uint8_t sequence);
+};
@@ -0,0 +1,508 @@
+#include <string.h>
+#include "requestParser.hpp"
+
+enum FieldIndex : int8_t {
+    FIELD_INDEX_EFFECT = 0,
+    FIELD_INDEX_EFFECT_SPEED,
+    FIELD_INDEX_COLOR,
+    FIELD_INDEX_BRIGHTNESS,
+    FIELD_INDEX_TRANSITION,
+    FIELD_INDEX_RAINBOW_SPEED,
+    FIELD_INDEX_RAINBOW_SPREAD,
+    FIELD_INDEX_COUNT,
+};
+
+struct FieldSpec {
+    const char *name;
+    int32_t max;                // the minimum is 0
+    const char *message;
+};
+
+static const FieldSpec fields[FIELD_INDEX_COUNT] = {
+    {"effect", ANIMATION, "Invalid effect. Must be an integer between 0 and 4"},
+    {"effectSpeed", 255, "Invalid effect speed. Must be an integer between 0 and 255"},
+    {"color", 255, "Invalid color. Must be an array of 3 integers between 0 and 255"},
+    {"brightness", 255, "Invalid brightness. Must be an integer between 0 and 255"},
+    {"transitionMs", 65535, "Invalid transition duration. Must be an integer between 0 and 65535"},
+    {"rainbowSpeed", 65535, "Invalid rainbow speed. Must be an integer between 0 and 65535"},
+    {"rainbowSpread", 65535, "Invalid rainbow spread. Must be an integer between 0 and 65535"},
+};
+
+static inline bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+RequestParser::RequestParser()
+{
+    reset();
+}
+
+/**
+ * @brief Start a new body.
+ */
+void RequestParser::reset()
+{
+    state = OBJECT_START;
+    field = -1;
+    length = 0;
+    overflow = false;
+    escape = false;
+    hexDigits = 0;
+    code = 0;
+    inString = false;
+    depth = 0;
+    brackets = 0;
+    colorCount = 0;
+    offset = 0;
+    data = default_request_data();
+    error = {nullptr, nullptr, 0};
+}
+
+/**
+ * @brief Parse the next chunk of the body.
+ * @return false if the body is invalid (see getError())
+ */
+bool RequestParser::feed(const char *chunk, size_t chunkLength)
+{
+    for (size_t i = 0; i < chunkLength && !failed(); i++, offset++)
+    {
+        step(chunk[i]);
+    }
+    return !failed();
+}
+
+/**
+ * @brief Check that the body ended after the object.
+ * @return false if the body is invalid or incomplete, the data must not be used then
+ */
+bool RequestParser::finish()
+{
+    if (!failed() && state != DONE)
+    {
+        fail("body", "Unexpected end of the body");
+    }
+    return !failed();
+}
+
+void RequestParser::fail(const char *field, const char *message)
+{
+    if (!failed())
+    {
+        error = {field, message, offset};
+    }
+}
+
+void RequestParser::step(char c)
+{
+    // a state which does not consume the character passes it on with continue
+    for (;;)
+    {
+        switch (state)
+        {
+            case OBJECT_START:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c != '{')
+                {
+                    return fail("body", "Must be a JSON object");
+                }
+                state = KEY_OR_END;
+                return;
+
+            case KEY_OR_END:
+                if (c == '}')
+                {
+                    state = DONE;
+                    return;
+                }
+                [[fallthrough]];
+            case KEY_START:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c != '"')
+                {
+                    return fail("body", "Expected a key in double quotes");
+                }
+                state = KEY;
+                length = 0;
+                overflow = false;
+                return;
+
+            case KEY:
+                if (c == '"')
+                {
+                    field = -1;
+                    for (int8_t i = 0; !overflow && i < FIELD_INDEX_COUNT; i++)
+                    {
+                        if (strlen(fields[i].name) == length && memcmp(fields[i].name, arena, length) == 0)
+                        {
+                            field = i;
+                        }
+                    }
+                    state = COLON;
+                    return;
+                }
+                if ((uint8_t)c < 0x20)
+                {
+                    return fail("body", "Control character in a key");
+                }
+                if (c == '\\')
+                {
+                    hexDigits = 0;
+                    state = KEY_ESCAPE;
+                    return;
+                }
+                appendKey(c);
+                return;
+
+            case KEY_ESCAPE:
+                if (hexDigits)
+                {
+                    uint8_t digit;
+                    if (isDigit(c))
+                    {
+                        digit = c - '0';
+                    }
+                    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                    {
+                        digit = (c | 0x20) - 'a' + 10;
+                    }
+                    else
+                    {
+                        return fail("body", "Invalid escape sequence in a key");
+                    }
+                    code = code << 4 | digit;
+                    if (--hexDigits == 0)
+                    {
+                        // the known keys are ASCII, any other character makes the key unknown
+                        if (code < 0x80)
+                        {
+                            appendKey(code);
+                        }
+                        else
+                        {
+                            overflow = true;
+                        }
+                        state = KEY;
+                    }
+                    return;
+                }
+                switch (c)
+                {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        appendKey(c);
+                        break;
+                    case 'b':
+                    case 'f':
+                    case 'n':
+                    case 'r':
+                    case 't':
+                        overflow = true;
+                        break;
+                    case 'u':
+                        hexDigits = 4;
+                        code = 0;
+                        return;
+                    default:
+                        return fail("body", "Invalid escape sequence in a key");
+                }
+                state = KEY;
+                return;
+
+            case COLON:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c != ':')
+                {
+                    return fail("body", "Expected a colon after the key");
+                }
+                state = VALUE;
+                return;
+
+            case VALUE:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                length = 0;
+                overflow = false;
+                if (field < 0)
+                {
+                    state = SKIP;
+                    inString = false;
+                    escape = false;
+                    depth = 0;
+                    continue;
+                }
+                if (field == FIELD_INDEX_COLOR)
+                {
+                    if (c != '[')
+                    {
+                        return fail(fields[field].name, fields[field].message);
+                    }
+                    colorCount = 0;
+                    state = COLOR_ELEMENT;
+                    return;
+                }
+                if (c != '-' && !isDigit(c))
+                {
+                    return fail(fields[field].name, fields[field].message);
+                }
+                state = NUMBER;
+                continue;
+
+            case COLOR_ELEMENT:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c != '-' && !isDigit(c))
+                {
+                    return fail(fields[field].name, fields[field].message);
+                }
+                length = 0;
+                overflow = false;
+                state = COLOR_NUMBER;
+                continue;
+
+            case NUMBER:
+            case COLOR_NUMBER:
+                if (isDigit(c) || c == '-')
+                {
+                    if (length < ARENA_SIZE)
+                    {
+                        arena[length++] = c;
+                    }
+                    else
+                    {
+                        overflow = true;
+                    }
+                    return;
+                }
+                if (!isWhitespace(c) && c != ',' && c != '}' && c != ']')
+                {
+                    // fractions, exponents and other garbage
+                    return fail(fields[field].name, fields[field].message);
+                }
+                if (!finishNumber())
+                {
+                    return;
+                }
+                state = state == NUMBER ? AFTER_VALUE : AFTER_COLOR_ELEMENT;
+                continue;
+
+            case AFTER_COLOR_ELEMENT:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c == ',' && colorCount < 3)
+                {
+                    state = COLOR_ELEMENT;
+                    return;
+                }
+                if (c == ']' && colorCount == 3)
+                {
+                    data.color = RgbColor(color[0], color[1], color[2]);
+                    state = AFTER_VALUE;
+                    return;
+                }
+                return fail(fields[field].name, fields[field].message);
+
+            case SKIP:
+                if (skip(c))
+                {
+                    return;
+                }
+                continue;
+
+            case AFTER_VALUE:
+                if (isWhitespace(c))
+                {
+                    return;
+                }
+                if (c == ',')
+                {
+                    state = KEY_START;
+                    return;
+                }
+                if (c != '}')
+                {
+                    return fail("body", "Expected a comma or a closing brace after the value");
+                }
+                state = DONE;
+                return;
+
+            case DONE:
+                if (!isWhitespace(c))
+                {
+                    return fail("body", "Unexpected data after the object");
+                }
+                return;
+        }
+    }
+}
+
+void RequestParser::appendKey(char c)
+{
+    if (length < ARENA_SIZE)
+    {
+        arena[length++] = c;
+    }
+    else
+    {
+        overflow = true;
+    }
+}
+
+/**
+ * @brief Skip a value of an unknown field. Only the strings and the nesting of the
+ * brackets are checked, numbers and literals are not validated.
+ * @return false if the value ended before the character, it is passed on to AFTER_VALUE
+ */
+bool RequestParser::skip(char c)
+{
+    if (inString)
+    {
+        if (escape)
+        {
+            escape = false;
+        }
+        else if (c == '\\')
+        {
+            escape = true;
+        }
+        else if (c == '"')
+        {
+            inString = false;
+            if (depth == 0)
+            {
+                state = AFTER_VALUE;
+            }
+        }
+        else if ((uint8_t)c < 0x20)
+        {
+            fail("body", "Control character in a string");
+        }
+        return true;
+    }
+
+    switch (c)
+    {
+        case '"':
+            inString = true;
+            return true;
+        case '{':
+        case '[':
+            if (depth == MAX_DEPTH)
+            {
+                fail("body", "Nested too deep");
+                return true;
+            }
+            brackets = (brackets & ~(1u << depth)) | (c == '{') << depth;
+            depth++;
+            return true;
+        case '}':
+        case ']':
+            if (depth == 0)
+            {
+                // closes the object, the value before was a number or literal
+                state = AFTER_VALUE;
+                return false;
+            }
+            depth--;
+            if (((brackets >> depth) & 1) != (c == '}'))
+            {
+                fail("body", "Mismatched bracket");
+                return true;
+            }
+            if (depth == 0)
+            {
+                state = AFTER_VALUE;
+            }
+            return true;
+        case ',':
+            if (depth == 0)
+            {
+                state = AFTER_VALUE;
+                return false;
+            }
+            return true;
+        default:
+            if (depth == 0 && isWhitespace(c))
+            {
+                state = AFTER_VALUE;
+                return false;
+            }
+            return true;
+    }
+}
+
+/**
+ * @brief Validate the number in the arena and store it in the current field.
+ * @return false if it is not an integer in the range of the field
+ */
+bool RequestParser::finishNumber()
+{
+    const FieldSpec &spec = fields[field];
+    const char *digits = arena;
+    const char *end = arena + length;
+    const bool negative = digits < end && *digits == '-';
+    if (negative)
+    {
+        digits++;
+    }
+    // -?(0|[1-9][0-9]*)
+    bool valid = !overflow && digits < end && (*digits != '0' || end - digits == 1);
+    int64_t value = 0;
+    for (const char *p = digits; valid && p < end; p++)
+    {
+        valid = isDigit(*p);
+        value = value * 10 + (*p - '0');
+    }
+    if (!valid || (negative && value != 0) || value > spec.max)
+    {
+        fail(spec.name, spec.message);
+        return false;
+    }
+
+    switch (field)
+    {
+        case FIELD_INDEX_EFFECT:
+            data.effect = (Effect)value;
+            break;
+        case FIELD_INDEX_EFFECT_SPEED:
+            data.effectSpeed = value;
+            break;
+        case FIELD_INDEX_COLOR:
+            color[colorCount++] = value;
+            break;
+        case FIELD_INDEX_BRIGHTNESS:
+            data.brightness = value;
+            break;
+        case FIELD_INDEX_TRANSITION:
+            data.transitionMs = value;
+            break;
+        case FIELD_INDEX_RAINBOW_SPEED:
+            data.rainbowSpeed = value;
+            break;
+        case FIELD_INDEX_RAINBOW_SPREAD:
+            data.rainbowSpread = value;
+            break;
+    }
+    return true;
+}
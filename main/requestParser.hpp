@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <optional>
+#include "controller.hpp"
+
+struct request_data
+{
+    std::optional<RgbColor> color;
+    std::optional<uint8_t> brightness;
+    std::optional<Effect> effect;
+    std::optional<uint8_t> effectSpeed;
+    std::optional<uint16_t> rainbowSpeed;
+    std::optional<uint16_t> rainbowSpread;
+    std::optional<uint16_t> transitionMs;
+};
+
+inline request_data default_request_data() {
+    return request_data {
+        .color = std::nullopt,
+        .brightness = std::nullopt,
+        .effect = std::nullopt,
+        .effectSpeed = std::nullopt,
+        .rainbowSpeed = std::nullopt,
+        .rainbowSpread = std::nullopt,
+        .transitionMs = std::nullopt
+    };
+}
+
+/**
+ * @brief The first error of a request body.
+ * field: the field of the schema or "body" for syntax errors
+ * offset: byte offset in the body at which the error was detected
+ */
+struct request_error
+{
+    const char *field;
+    const char *message;
+    size_t offset;
+};
+
+/**
+ * @brief Single-pass JSON parser for the body of POST /color.
+ *
+ * The body is fed in chunks as it is received, the parser does not allocate and
+ * only buffers the current key or number in a fixed arena. The known fields are
+ * validated against the schema while they are parsed, other fields are skipped
+ * (nested up to MAX_DEPTH). Parsing stops at the first error.
+ */
+class RequestParser {
+public:
+    static constexpr size_t ARENA_SIZE = 16;        // longer keys are unknown, longer numbers out of range
+    static constexpr uint8_t MAX_DEPTH = 16;        // nesting of skipped values
+
+    RequestParser();
+
+    void reset();
+    bool feed(const char *data, size_t length);
+    bool finish();
+
+    bool failed() const { return error.message != nullptr; }
+    const request_data &getData() const { return data; }
+    const request_error &getError() const { return error; }
+
+private:
+    enum State : uint8_t {
+        OBJECT_START,           // before the opening brace
+        KEY_OR_END,             // after the opening brace
+        KEY_START,              // after a comma
+        KEY,                    // inside the quotes of a key
+        KEY_ESCAPE,             // after a backslash in a key
+        COLON,
+        VALUE,
+        NUMBER,
+        COLOR_ELEMENT,          // before a color value
+        COLOR_NUMBER,
+        AFTER_COLOR_ELEMENT,
+        SKIP,                   // inside a value of an unknown field
+        AFTER_VALUE,
+        DONE,                   // after the closing brace
+    };
+
+    State state;
+    int8_t field;               // index of the current field, -1 if unknown
+    uint8_t length;             // of the token in the arena
+    bool overflow;              // the token did not fit into the arena
+    bool escape;                // SKIP: the previous character of a string was a backslash
+    uint8_t hexDigits;          // KEY_ESCAPE: remaining digits of a \uXXXX sequence
+    uint16_t code;              // KEY_ESCAPE: code point of the \uXXXX sequence
+    bool inString;              // SKIP: inside a string
+    uint8_t depth;              // SKIP: open brackets
+    uint16_t brackets;          // SKIP: bit n is set if bracket n is a brace
+    uint8_t colorCount;
+    uint8_t color[3];
+    size_t offset;
+    char arena[ARENA_SIZE];
+    request_data data;
+    request_error error;
+
+    void step(char c);
+    bool finishNumber();
+    bool skip(char c);
+    void appendKey(char c);
+    void fail(const char *field, const char *message);
+};
@@ -3,14 +3,26 @@
 #include "esp_http_server.h"
 #include "esp_event.h"
 #include <sys/param.h>
+#include <unistd.h>
 #include "cJSON.h"
+#include "jsonArena.hpp"
 #include "server.hpp"
-#include "esp_spiffs.h"
 
 const char *Server::TAG = "Server";
 
-Server::Server(Controller& ctrlPtr) : controller(ctrlPtr)
+Server::Server(Controller& ctrlPtr, Metrics& metrics, StateStore *stateStore) :
+    controller(ctrlPtr),
+    metrics(metrics),
+    stateStore(stateStore),
+    control(ctrlPtr),
+    wsBuffer(control.getMaxMessageLength()),
+    segments{}
 {
+    for (size_t i = 0; i < MAX_WS_CLIENTS; i++)
+    {
+        wsClients[i] = -1;
+    }
+    JsonArena::install();
     server = start();
     
 }
@@ -23,7 +35,17 @@ Server::~Server()
 httpd_handle_t Server::start()
 {
     httpd_handle_t server = NULL;
+    if (mount_storage() != ESP_OK)
+    {
+        ESP_LOGW(Server::TAG, "The landing page is not available");
+    }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // the WebSocket clients are removed when their socket is closed
+    config.global_user_ctx = this;
+    config.global_user_ctx_free_fn = [](void *ctx) {};
+    config.close_fn = close_handler;
+    config.max_uri_handlers = 10;
 
     // Start the httpd server
     ESP_LOGI(Server::TAG, "Starting server on port: '%d'", config.server_port);
@@ -37,205 +59,231 @@ httpd_handle_t Server::start()
     ESP_LOGI(Server::TAG, "Registering URI handlers");
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &status));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &color));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &frame));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &segments_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &pixels));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &metrics_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &landing_page));
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &ws));
+#else
+    ESP_LOGW(Server::TAG, "CONFIG_HTTPD_WS_SUPPORT is disabled, the WebSocket control channel is not available");
+#endif
+
+    // the realtime receiver switches to the STREAM effect without a request
+    stateTimer = xTimerCreate("serverState", pdMS_TO_TICKS(500), pdTRUE, this, state_timer_callback);
+    if (!stateTimer || xTimerStart(stateTimer, 0) != pdPASS)
+    {
+        ESP_LOGW(Server::TAG, "Failed to start the state timer, the clients see a switch to the stream with the next change");
+    }
     return server;
 }
 
+/**
+ * Mount the SPIFFS partition and read the static files into the cache, they are
+ * not read from the flash again.
+ */
 esp_err_t Server::mount_storage()
 {
-    return ESP_OK;
+    esp_err_t ret = assets.mount();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    return assets.load("/", "landing_page.html", "text/html");
 }
 
 
 
 void Server::stop()
 {
+    if (stateTimer)
+    {
+        xTimerDelete(stateTimer, portMAX_DELAY);
+        stateTimer = NULL;
+    }
     ESP_ERROR_CHECK(httpd_stop(server));
 }
 
 /**
- * Parse the request data and populate the request_data struct
- * return ESP_OK if successful, ESP_FAIL otherwise
+ * Runs on the timer task, the state is checked on the server task.
  */
-esp_err_t parse_request_data(const char *buf, request_data *data, cJSON *parsingError)
+void Server::state_timer_callback(TimerHandle_t timer)
 {
-    auto jsonData = cJSON_Parse(buf);
-    if (jsonData == NULL)
+    auto self = (Server *)pvTimerGetTimerID(timer);
+    if (self->server && self->control.hasStreamSwitch())
     {
-        ESP_LOGE(Server::TAG, "Error parsing JSON");
-        return ESP_FAIL;
-    }
-
-    cJSON *effect = cJSON_GetObjectItem(jsonData, "effect");
-    cJSON *effectSpeed = cJSON_GetObjectItem(jsonData, "effectSpeed");
-    cJSON *targetColor = cJSON_GetObjectItem(jsonData, "color");
-    cJSON *targetBrightness = cJSON_GetObjectItem(jsonData, "brightness");
-
-    // Check if the effect is present and is a number
-    if (effect != NULL) {
-        if (!cJSON_IsNumber(effect))
-        {
-            cJSON_AddStringToObject(parsingError, "effect", "Invalid effect format. Must be an integer");
-            return ESP_FAIL;
-        }
-        data->effect = (Effect)effect->valueint;
-    }
-
-    // Check if the effectSpeed is present and is a number
-    if (effectSpeed != NULL) {
-        if (!cJSON_IsNumber(effectSpeed))
-        {
-            cJSON_AddStringToObject(parsingError, "effectSpeed", "Invalid effect speed format. Must be an integer");
-            return ESP_FAIL;
-        }
-        data->effectSpeed = effectSpeed->valueint;
-    }
-
-    // Check if the targetBrightness is present and is a number
-    if (targetBrightness != NULL){
-        if (!cJSON_IsNumber(targetBrightness))
-        {
-            cJSON_AddStringToObject(parsingError, "targetBrightness", "Invalid brightness format. Must be an integer");
-            return ESP_FAIL;
-        }
-        data->brightness = targetBrightness->valueint;
+        httpd_queue_work(self->server, sync_state, self);
     }
+}
 
-    // Check if the targetColor is present and is an array of 3 integers
-    if (targetColor != NULL)
+/**
+ * Broadcast a switch to the STREAM effect which did not come from a client.
+ */
+void Server::sync_state(void *arg)
+{
+    auto self = (Server *)arg;
+    if (self->control.takeStateChange())
     {
-        if (!cJSON_IsArray(targetColor) || cJSON_GetArraySize(targetColor) != 3)
-        {
-            ESP_LOGE(Server::TAG, "Invalid color format");
-            cJSON_AddStringToObject(parsingError, "targetColor", "Invalid color format. Must be an array of 3 integers");
-            return ESP_FAIL;
-        }
-
-        int r = cJSON_GetArrayItem(targetColor, 0)->valueint;
-        int g = cJSON_GetArrayItem(targetColor, 1)->valueint;
-        int b = cJSON_GetArrayItem(targetColor, 2)->valueint;
-        if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255)
-        {
-            ESP_LOGE(Server::TAG, "Invalid color values");
-            cJSON_AddStringToObject(parsingError, "targetColor", "Invalid color values. Must be between 0 and 255");
-            return ESP_FAIL;
-        }
-
-        data->color = RgbColor(r, g, b);
+        self->broadcast_state(self->server);
     }
-
-    cJSON_Delete(jsonData);
-
-    return ESP_OK;
 }
 
-esp_err_t send_error_response(httpd_req_t *req, cJSON *error)
+esp_err_t send_error_response(httpd_req_t *req, cJSON *error, const char *status = "400 Bad Request")
 {
     char *resp_str = cJSON_Print(error);
+    if (resp_str == NULL)
+    {
+        cJSON_Delete(error);
+        return httpd_resp_send_500(req);
+    }
 
     esp_err_t err;
-    if((err = httpd_resp_set_status(req, "400 Bad Request")) != ESP_OK) { 
+    if((err = httpd_resp_set_status(req, status)) != ESP_OK) { 
         cJSON_Delete(error);
-        free(resp_str);   
+        cJSON_free(resp_str);   
         return err;
     }
     if((err = httpd_resp_set_type(req, "application/json")) != ESP_OK) { 
         cJSON_Delete(error);
-        free(resp_str);   
+        cJSON_free(resp_str);   
         return err;
     }
     if((err = httpd_resp_send(req, resp_str, strlen(resp_str))) != ESP_OK) { 
         cJSON_Delete(error);
-        free(resp_str);   
+        cJSON_free(resp_str);   
         return err;
     }
 
     cJSON_Delete(error);
-    free(resp_str);
+    cJSON_free(resp_str);
     return ESP_OK;
 }
 
+/**
+ * Handler of the static files (see AssetCache). The response can be cached by the
+ * browser, it revalidates it with the ETag and gets 304 Not Modified while it is current.
+ */
 esp_err_t Server::landing_page_handler(httpd_req_t *req)
 {
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = "/spiffs",
-        .partition_label = NULL,
-        .max_files = 5,
-        .format_if_mount_failed = false,
-    };
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-
-    if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount or format filesystem");
-        } else if (ret == ESP_ERR_NOT_FOUND) {
-            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
-        }
-        return ret;
-    }
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_ASSET);
 
-    size_t total = 0, used = 0;
-    ret = esp_spiffs_info(NULL, &total, &used);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(ret));
-    } else {
-        ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
+    // the query is not part of the asset URI
+    char uri[32];
+    size_t length = strcspn(req->uri, "?");
+    if (length >= sizeof(uri))
+    {
+        return httpd_resp_send_404(req);
     }
+    memcpy(uri, req->uri, length);
+    uri[length] = '\0';
 
-    struct stat st;
-    if (stat("/spiffs/landing_page.html", &st) == 0) {
-        ESP_LOGI(TAG, "Reading file");
-        FILE* file = fopen("/spiffs/landing_page.html", "r");
-        if (file == NULL) {
-            ESP_LOGE(TAG, "Failed to open file for reading");
-            return ESP_ERR_NOT_FOUND;
-        }
-
-        // iterate over the file and send the chunks to the client
-        char line[256];
-        ssize_t read;
-
-        while ((read = fread(line, 1, sizeof(line), file)) > 0) {
-            ESP_ERROR_CHECK(httpd_resp_send_chunk(req, line, read));
-        }
-
-        ESP_ERROR_CHECK(httpd_resp_send_chunk(req, NULL, 0));
-        
-        fclose(file);
-    } else {
-        ESP_LOGE(TAG, "landing_page.html not found");
-        ESP_ERROR_CHECK(httpd_resp_send_404(req));
+    const Asset *asset = self->assets.find(uri);
+    if (asset == NULL)
+    {
+        ESP_LOGE(TAG, "%s not found", uri);
+        return httpd_resp_send_404(req);
     }
 
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "ETag", asset->etag));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
 
-    esp_vfs_spiffs_unregister(NULL);
+    char etag[sizeof(asset->etag)];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag, sizeof(etag)) == ESP_OK && strcmp(etag, asset->etag) == 0)
+    {
+        ESP_ERROR_CHECK(httpd_resp_set_status(req, "304 Not Modified"));
+        return httpd_resp_send(req, NULL, 0);
+    }
 
-    return ESP_OK;
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, asset->type));
+    if (asset->gzip)
+    {
+        ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Content-Encoding", "gzip"));
+    }
+    return httpd_resp_send(req, (const char *)asset->data.data(), asset->data.size());
 }
 
 /* Server status handler */
 esp_err_t Server::status_handler(httpd_req_t *req)
 {
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_STATUS);
+    JsonArena::Scope arena;
     cJSON *json = cJSON_CreateObject();
     cJSON_AddStringToObject(json, "status", "ok");
-    char *resp_str = cJSON_Print(json);
+    cJSON_AddNumberToObject(json, "pixels", self->controller.getPixelCount());
+
+    cJSON *segments = cJSON_CreateArray();
+    cJSON_AddItemToObject(json, "segments", segments);
+    for (uint8_t i = 0; i < self->segments.count; i++)
+    {
+        const Segment &segment = self->segments.segments[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "start", segment.start);
+        cJSON_AddNumberToObject(item, "length", segment.length);
+        cJSON_AddNumberToObject(item, "effect", segment.effect);
+        const int color[3] = {segment.color.r, segment.color.g, segment.color.b};
+        cJSON_AddItemToObject(item, "color", cJSON_CreateIntArray(color, 3));
+        cJSON_AddNumberToObject(item, "effectSpeed", segment.effectSpeed);
+        cJSON_AddNumberToObject(item, "brightness", segment.brightness);
+        cJSON_AddItemToArray(segments, item);
+    }
+
+    // the buffer fits 8 segments, so it does not grow while printing
+    char *resp_str = cJSON_PrintBuffered(json, 1536, true);
+    if (resp_str == NULL)
+    {
+        cJSON_Delete(json);
+        return httpd_resp_send_500(req);
+    }
     ESP_ERROR_CHECK(httpd_resp_set_type(req, "application/json"));
     ESP_ERROR_CHECK(httpd_resp_send(req, resp_str, strlen(resp_str)));
 
     cJSON_Delete(json);
-    free(resp_str);
+    cJSON_free(resp_str);
 
     return ESP_OK;
 }
 
+/**
+ * Send an error as {"<field>": "<message>", "offset": <offset>} without allocating.
+ * The field and the message must not contain quotes.
+ */
+esp_err_t send_request_error(httpd_req_t *req, const request_error &error, const char *status = "400 Bad Request")
+{
+    char body[160];
+    int length = snprintf(body, sizeof(body), "{\"%s\": \"%s\", \"offset\": %u}", error.field, error.message, (unsigned)error.offset);
+
+    esp_err_t err;
+    if ((err = httpd_resp_set_status(req, status)) != ESP_OK ||
+        (err = httpd_resp_set_type(req, "application/json")) != ESP_OK)
+    {
+        return err;
+    }
+    return httpd_resp_send(req, body, MIN(length, (int)sizeof(body) - 1));
+}
+
 /* Handler to change the led strip */
 esp_err_t Server::color_handler(httpd_req_t *req){
-    char buf[200];
-    int ret, remaining = req->content_len;
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_COLOR);
 
-    while (remaining > 0)
+    // check if header is application/json
+    char header_buf[100];
+    if (httpd_req_get_hdr_value_str(req, "Content-Type", header_buf, sizeof(header_buf)) == ESP_OK)
+    {
+        if (strcmp(header_buf, "application/json") != 0)
+        {
+            return send_request_error(req, {"Content-Type", "Invalid content type. Must be application/json", 0});
+        }
+    }
+
+    // the body is parsed while it is received, the rest is discarded after an error
+    RequestParser parser;
+    char buf[64];
+    int ret, remaining = req->content_len;
+    while (remaining > 0 && !parser.failed())
     {
         /* Read the data for the request */
         if ((ret = httpd_req_recv(req, buf,
@@ -249,62 +297,527 @@ esp_err_t Server::color_handler(httpd_req_t *req){
             return ESP_FAIL;
         }
 
+        parser.feed(buf, ret);
         remaining -= ret;
     }
 
-    ESP_LOGI(Server::TAG, "Received body: %s", buf);
-    auto requestError = cJSON_CreateObject();
+    if (!parser.finish())
+    {
+        const request_error &error = parser.getError();
+        ESP_LOGW(Server::TAG, "Invalid request at %u: %s: %s", (unsigned)error.offset, error.field, error.message);
+        return send_request_error(req, error);
+    }
+    const request_data &data = parser.getData();
 
-    // check if header is application/json
-    char header_buf[100];
-    if (httpd_req_get_hdr_value_str(req, "Content-Type", header_buf, sizeof(header_buf)) == ESP_OK)
+    // the changes are applied by the controller task at the next frame
+    bool queued = true;
+    if (data.effectSpeed.has_value())
     {
-        if (strcmp(header_buf, "application/json") != 0)
+        queued &= self->control.set(FIELD_EFFECT_SPEED, data.effectSpeed.value());
+    }
+    if (data.transitionMs.has_value())
+    {
+        queued &= self->control.set(FIELD_TRANSITION, data.transitionMs.value());
+    }
+    if (data.rainbowSpeed.has_value())
+    {
+        queued &= self->control.set(FIELD_RAINBOW_SPEED, data.rainbowSpeed.value());
+    }
+    if (data.rainbowSpread.has_value())
+    {
+        queued &= self->control.set(FIELD_RAINBOW_SPREAD, data.rainbowSpread.value());
+    }
+    if (data.color.has_value())
+    {
+        queued &= self->control.set(FIELD_COLOR, ControllerCommand::packColor(data.color.value()));
+    }
+    if (data.brightness.has_value())
+    {
+        queued &= self->control.set(FIELD_BRIGHTNESS, data.brightness.value());
+    }    
+    if (data.effect.has_value())
+    {
+        ESP_LOGI(Server::TAG, "Setting effect to %d", data.effect.value());
+        queued &= self->control.set(FIELD_EFFECT, data.effect.value());
+    }
+
+    if (self->control.takeStateChange())
+    {
+        self->broadcast_state(req->handle);
+    }
+
+    if (!queued)
+    {
+        ESP_LOGW(Server::TAG, "Command queue full, the request was applied partly");
+        return send_request_error(req, {"body", "Too many updates, the controller did not apply all of them yet", 0},
+                                  "503 Service Unavailable");
+    }
+
+    ESP_ERROR_CHECK(httpd_resp_send(req, NULL, 0));
+    return ESP_OK;
+}
+
+/**
+ * Handler to upload a frame. The body contains the raw colors of the pixels
+ * (R, G, B or R, G, B, W for strips with white) and is received directly into
+ * the stream buffer of the controller. The optional X-Pixel-Offset header is the
+ * index of the first pixel in the body, the other pixels keep their colors.
+ * The controller switches to the STREAM effect.
+ */
+esp_err_t Server::frame_handler(httpd_req_t *req)
+{
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_FRAME);
+    JsonArena::Scope arena;
+    Controller &controller = self->controller;
+    const size_t channels = controller.getChannelsPerPixel();
+    size_t offset = 0;
+
+    char header_buf[12];
+    esp_err_t header = httpd_req_get_hdr_value_str(req, "X-Pixel-Offset", header_buf, sizeof(header_buf));
+    if (header != ESP_ERR_NOT_FOUND)
+    {
+        // strtoul accepts a sign and wraps, so only digits are valid
+        char *end = header_buf;
+        unsigned long pixel = header == ESP_OK ? strtoul(header_buf, &end, 10) : 0;
+        if (header != ESP_OK || header_buf[0] < '0' || header_buf[0] > '9' || *end != '\0' ||
+            pixel >= controller.getPixelCount())
         {
-            cJSON_AddStringToObject(requestError, "Content-Type", "Invalid content type. Must be application/json");
+            auto requestError = cJSON_CreateObject();
+            cJSON_AddStringToObject(requestError, "X-Pixel-Offset", "Invalid offset. Must be the index of a pixel of the strip");
+            cJSON_AddNumberToObject(requestError, "pixels", controller.getPixelCount());
             return send_error_response(req, requestError);
         }
+        offset = pixel * channels;
+    }
+
+    size_t remaining = req->content_len;
+    if (remaining == 0 || remaining % channels != 0 || remaining > controller.getStreamBufferSize() - offset)
+    {
+        auto requestError = cJSON_CreateObject();
+        cJSON_AddStringToObject(requestError, "body", "Invalid frame size. Must be a multiple of the channels per pixel and fit into the strip");
+        cJSON_AddNumberToObject(requestError, "channels", channels);
+        cJSON_AddNumberToObject(requestError, "pixels", controller.getStreamBufferSize() / channels);
+        return send_error_response(req, requestError);
+    }
+
+    // the controller only holds the buffer while it copies it into the pixels
+    uint8_t *buffer = controller.acquireStreamBuffer();
+    for (uint8_t retry = 0; buffer == nullptr && retry < 3; retry++)
+    {
+        vTaskDelay(1);
+        buffer = controller.acquireStreamBuffer();
+    }
+    if (buffer == nullptr)
+    {
+        auto requestError = cJSON_CreateObject();
+        cJSON_AddStringToObject(requestError, "body", "The frame buffer is busy");
+        return send_error_response(req, requestError, "503 Service Unavailable");
+    }
+
+    char *dst = (char *)buffer + offset;
+    while (remaining > 0)
+    {
+        int ret = httpd_req_recv(req, dst, remaining);
+        if (ret <= 0)
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                /* Retry receiving if timeout occurred */
+                continue;
+            }
+            // a partly received frame is not shown
+            if (dst == (char *)buffer + offset)
+            {
+                controller.releaseStreamBuffer(false);
+            }
+            else
+            {
+                controller.discardStreamBuffer();
+            }
+            return ESP_FAIL;
+        }
+        dst += ret;
+        remaining -= ret;
+    }
+    controller.releaseStreamBuffer(true);
+
+    if (self->control.markStreaming() && self->control.takeStateChange())
+    {
+        self->broadcast_state(req->handle);
+    }
+
+    ESP_ERROR_CHECK(httpd_resp_send(req, NULL, 0));
+    return ESP_OK;
+}
+
+/**
+ * Handler of sparse pixel updates. The body holds the records of ControlProtocol::writeSparse()
+ * (single pixels and runs), which are shown together with the next frame.
+ * The controller switches to the STREAM effect.
+ */
+esp_err_t Server::pixels_handler(httpd_req_t *req)
+{
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_PIXELS);
+
+    // the WebSocket buffer is free, all handlers run on the server task
+    auto &body = self->wsBuffer;
+    const size_t length = req->content_len;
+    if (length == 0 || length > body.size())
+    {
+        return send_request_error(req, {"body", "Invalid body size", 0});
+    }
+
+    size_t received = 0;
+    while (received < length)
+    {
+        int ret = httpd_req_recv(req, (char *)body.data() + received, length - received);
+        if (ret <= 0)
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                /* Retry receiving if timeout occurred */
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        received += ret;
     }
 
-    auto jsonData = cJSON_Parse(buf);
-    if (jsonData == NULL)
+    size_t offset;
+    switch (self->control.writeSparse(body.data(), length, offset))
     {
-        cJSON_AddStringToObject(requestError, "body", "Invalid JSON format");
-        auto result = send_error_response(req, requestError);
-        cJSON_Delete(jsonData);
-        return result;
+        case CONTROL_OK:
+            break;
+        case CONTROL_TRUNCATED:
+            return send_request_error(req, {"body", "The record is truncated", offset});
+        case CONTROL_INVALID_VALUE:
+            return send_request_error(req, {"body", "Invalid record. Must be 1 (pixel) or 2 (run)", offset});
+        case CONTROL_OUT_OF_RANGE:
+            return send_request_error(req, {"body", "The pixels must fit into the strip", offset});
+        default:
+            return send_request_error(req, {"body", "The frame buffer is busy", 0}, "503 Service Unavailable");
     }
 
-    request_data data = default_request_data();
-    if(parse_request_data(buf, &data, requestError) != ESP_OK)
+    if (self->control.takeStateChange())
     {
-        auto result = send_error_response(req, requestError);
-        cJSON_Delete(jsonData);
-        return result;
+        self->broadcast_state(req->handle);
     }
+    ESP_ERROR_CHECK(httpd_resp_send(req, NULL, 0));
+    return ESP_OK;
+}
+
+/**
+ * Read a number of a segment, the segment is invalid if it is present but not an integer in range.
+ */
+static bool segment_value(cJSON *segment, const char *name, int max, int &value)
+{
+    cJSON *item = cJSON_GetObjectItem(segment, name);
+    if (item == NULL)
+    {
+        return true;
+    }
+    value = item->valueint;
+    return cJSON_IsNumber(item) && item->valuedouble == (double)value && value >= 0 && value <= max;
+}
+
+static esp_err_t send_segment_error(httpd_req_t *req, int index, const char *message)
+{
+    auto requestError = cJSON_CreateObject();
+    cJSON_AddStringToObject(requestError, "segments", message);
+    if (index >= 0)
+    {
+        cJSON_AddNumberToObject(requestError, "index", index);
+    }
+    return send_error_response(req, requestError);
+}
+
+/**
+ * Handler to set the segments: {"segments": [{"start": 0, "length": 50, "effect": 2, "color": [255, 0, 0],
+ * "effectSpeed": 10, "brightness": 128}, ...]}. start and length are required, effect (SOLID),
+ * color (white), effectSpeed (50) and brightness (255) are optional. An empty array returns to a
+ * single effect for the whole strip. The layout replaces the previous one at the next frame.
+ */
+esp_err_t Server::segments_handler(httpd_req_t *req)
+{
     auto self = (Server *)req->user_ctx;
-    if (data.effectSpeed.has_value())
+    RequestTimer timer(self->metrics, Metrics::HANDLER_SEGMENTS);
+    JsonArena::Scope arena;
+
+    char body[1024];
+    int remaining = req->content_len;
+    if (remaining <= 0 || remaining >= (int)sizeof(body))
     {
-        self->controller.setEffectSpeed(data.effectSpeed.value());
+        return send_segment_error(req, -1, "Invalid body size. Must be between 1 and 1023 bytes");
     }
-    if (data.color.has_value())
+    char *dst = body;
+    while (remaining > 0)
     {
-        self->controller.setTargetColor(data.color.value());
+        int ret = httpd_req_recv(req, dst, remaining);
+        if (ret <= 0)
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                /* Retry receiving if timeout occurred */
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        dst += ret;
+        remaining -= ret;
     }
-    if (data.brightness.has_value())
+    *dst = '\0';
+
+    cJSON *json = cJSON_Parse(body);
+    cJSON *array = cJSON_GetObjectItem(json, "segments");
+    if (!cJSON_IsArray(array) || cJSON_GetArraySize(array) > SegmentLayout::MAX_SEGMENTS)
     {
-        self->controller.setTargetBrightness(data.brightness.value());
-    }    
-    if (data.effect.has_value())
+        cJSON_Delete(json);
+        return send_segment_error(req, -1, "Must be an array of up to 8 segments");
+    }
+
+    SegmentLayout layout = {};
+    for (cJSON *item = array->child; item != NULL; item = item->next, layout.count++)
     {
-        ESP_LOGI(Server::TAG, "Setting effect to %d", data.effect.value());
-        self->controller.setEffect(data.effect.value());
+        int start = -1, length = -1, effect = SOLID, effectSpeed = 50, brightness = 255;
+        bool valid = cJSON_IsObject(item) &&
+                     segment_value(item, "start", UINT16_MAX, start) && start >= 0 &&
+                     segment_value(item, "length", UINT16_MAX, length) && length >= 0 &&
+                     segment_value(item, "effect", RAINBOW_CYCLE, effect) &&
+                     segment_value(item, "effectSpeed", 255, effectSpeed) &&
+                     segment_value(item, "brightness", 255, brightness);
+
+        RgbColor color(255, 255, 255);
+        cJSON *colorItem = cJSON_GetObjectItem(item, "color");
+        if (valid && colorItem != NULL)
+        {
+            int channels[3] = {-1, -1, -1};
+            valid = cJSON_IsArray(colorItem) && cJSON_GetArraySize(colorItem) == 3;
+            for (int i = 0; valid && i < 3; i++)
+            {
+                cJSON *channel = cJSON_GetArrayItem(colorItem, i);
+                channels[i] = channel->valueint;
+                valid = cJSON_IsNumber(channel) && channels[i] >= 0 && channels[i] <= 255;
+            }
+            color = RgbColor(channels[0], channels[1], channels[2]);
+        }
+        if (!valid)
+        {
+            cJSON_Delete(json);
+            return send_segment_error(req, layout.count, "Invalid segment. start and length are required, "
+                                      "effect 0 - 2, color [r, g, b], effectSpeed and brightness 0 - 255");
+        }
+        layout.segments[layout.count] = Segment{(uint16_t)start, (uint16_t)length, (Effect)effect, color,
+                                                (uint8_t)effectSpeed, (uint8_t)brightness};
+    }
+    cJSON_Delete(json);
+
+    uint8_t index;
+    const char *message = Controller::validateSegments(layout, self->controller.getPixelCount(), index);
+    if (message != nullptr)
+    {
+        return send_segment_error(req, index, message);
+    }
+
+    if (!self->controller.postSegments(layout))
+    {
+        auto requestError = cJSON_CreateObject();
+        cJSON_AddStringToObject(requestError, "body", "Too many updates, the controller did not apply the last layout yet");
+        return send_error_response(req, requestError, "503 Service Unavailable");
     }
+    self->segments = layout;
+    ESP_LOGI(Server::TAG, "Set %d segments", layout.count);
 
     ESP_ERROR_CHECK(httpd_resp_send(req, NULL, 0));
-    cJSON_Delete(requestError);
-    cJSON_Delete(jsonData);
     return ESP_OK;
 }
 
+static bool send_chunk(void *context, const char *data, size_t length)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)context, data, length) == ESP_OK;
+}
 
+/**
+ * Handler of the metrics, in the Prometheus text format or with ?format=json as JSON
+ * (see Metrics). The response is sent in chunks, nothing is allocated.
+ */
+esp_err_t Server::metrics_handler(httpd_req_t *req)
+{
+    auto self = (Server *)req->user_ctx;
+    RequestTimer timer(self->metrics, Metrics::HANDLER_METRICS);
+    self->metrics.addTask("httpd", xTaskGetCurrentTaskHandle());
+
+    char query[32];
+    char format[8];
+    bool json = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                httpd_query_key_value(query, "format", format, sizeof(format)) == ESP_OK &&
+                strcmp(format, "json") == 0;
+
+    MetricsWriter writer(send_chunk, req);
+    if (json)
+    {
+        ESP_ERROR_CHECK(httpd_resp_set_type(req, "application/json"));
+        self->metrics.writeJson(writer);
+    }
+    else
+    {
+        ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain; version=0.0.4"));
+        self->metrics.writePrometheus(writer);
+    }
+    if (!writer.finish())
+    {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/**
+ * Handler of the WebSocket control channel. A new client gets the current state,
+ * the binary messages are applied with ControlProtocol::handle(). A failing command
+ * is answered with an error message, every change is broadcast to all clients.
+ */
+esp_err_t Server::ws_handler(httpd_req_t *req)
+{
+    auto self = (Server *)req->user_ctx;
+    if (req->method == HTTP_GET)
+    {
+        // the handshake is done
+        int sockfd = httpd_req_to_sockfd(req);
+        if (!self->add_ws_client(sockfd))
+        {
+            ESP_LOGW(Server::TAG, "Too many WebSocket clients");
+            return ESP_FAIL;
+        }
+        if (self->control.takeStateChange())
+        {
+            // the new client is included
+            self->broadcast_state(req->handle);
+            return ESP_OK;
+        }
+        uint8_t message[ControlProtocol::STATE_MESSAGE_LENGTH];
+        return self->send_ws(req->handle, sockfd, message, self->control.encodeState(message));
+    }
+    RequestTimer timer(self->metrics, Metrics::HANDLER_WS);
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (frame.len > self->wsBuffer.size())
+    {
+        // the rest of the frame can not be skipped, the connection is closed
+        ESP_LOGW(Server::TAG, "WebSocket message too long (%d bytes)", frame.len);
+        return ESP_FAIL;
+    }
+    frame.payload = self->wsBuffer.data();
+    if ((ret = httpd_ws_recv_frame(req, &frame, frame.len)) != ESP_OK)
+    {
+        return ret;
+    }
+    if (frame.type != HTTPD_WS_TYPE_BINARY)
+    {
+        return ESP_OK;
+    }
+
+    uint8_t opcode = 0;
+    ControlError error = self->control.handle(frame.payload, frame.len, opcode);
+    if (error != CONTROL_OK)
+    {
+        uint8_t message[ControlProtocol::ERROR_MESSAGE_LENGTH];
+        self->send_ws(req->handle, httpd_req_to_sockfd(req), message, ControlProtocol::encodeError(message, opcode, error));
+    }
+    if (self->control.takeStateChange())
+    {
+        self->broadcast_state(req->handle);
+    }
+    return ESP_OK;
+}
+#else
+esp_err_t Server::ws_handler(httpd_req_t *req)
+{
+    return httpd_resp_send_404(req);
+}
+#endif
+
+bool Server::add_ws_client(int sockfd)
+{
+    for (size_t i = 0; i < MAX_WS_CLIENTS; i++)
+    {
+        if (wsClients[i] < 0)
+        {
+            wsClients[i] = sockfd;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Server::remove_ws_client(int sockfd)
+{
+    for (size_t i = 0; i < MAX_WS_CLIENTS; i++)
+    {
+        if (wsClients[i] == sockfd)
+        {
+            wsClients[i] = -1;
+        }
+    }
+}
+
+/**
+ * Send a binary message to a WebSocket client, the client is removed if it fails.
+ */
+esp_err_t Server::send_ws(httpd_handle_t handle, int sockfd, const uint8_t *message, size_t length)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = HTTPD_WS_TYPE_BINARY;
+    frame.payload = (uint8_t *)message;
+    frame.len = length;
+    esp_err_t ret = httpd_ws_send_frame_async(handle, sockfd, &frame);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(Server::TAG, "Failed to send to WebSocket client %d", sockfd);
+        remove_ws_client(sockfd);
+    }
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Send the state to all WebSocket clients and the state store. Called by the server task after a change.
+ */
+void Server::broadcast_state(httpd_handle_t handle)
+{
+    if (stateStore)
+    {
+        stateStore->update(control.getState());
+    }
+
+    uint8_t message[ControlProtocol::STATE_MESSAGE_LENGTH];
+    size_t length = control.encodeState(message);
+    for (size_t i = 0; i < MAX_WS_CLIENTS; i++)
+    {
+        if (wsClients[i] >= 0)
+        {
+            send_ws(handle, wsClients[i], message, length);
+        }
+    }
+}
+
+/**
+ * Replaces the default close of the server to remove closed WebSocket clients.
+ */
+void Server::close_handler(httpd_handle_t handle, int sockfd)
+{
+    auto self = (Server *)httpd_get_global_user_ctx(handle);
+    self->remove_ws_client(sockfd);
+    close(sockfd);
+}
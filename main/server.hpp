@@ -1,45 +1,58 @@
 #pragma once
 #include "controller.hpp"
+#include "controlProtocol.hpp"
+#include "assetCache.hpp"
+#include "requestParser.hpp"
+#include "metrics.hpp"
+#include "stateStore.hpp"
 #include "esp_log.h"
-#include <optional>
+#include "esp_http_server.h"
+#include "freertos/timers.h"
 #include <memory>
-
-struct request_data
-{
-    std::optional<RgbColor> color;
-    std::optional<uint8_t> brightness;
-    std::optional<Effect> effect;
-    std::optional<uint8_t> effectSpeed;
-};
-
-request_data default_request_data() {
-    return request_data {
-        .color = std::nullopt,
-        .brightness = std::nullopt,
-        .effect = std::nullopt,
-        .effectSpeed = std::nullopt
-    };
-}
+#include <vector>
 
 class Server
 {
 public:
     static const char *TAG;
-    Server(Controller& ctrlPtr);
+    Server(Controller& ctrlPtr, Metrics& metrics, StateStore *stateStore = NULL);
     ~Server();
     httpd_handle_t start();
     void stop();
     bool isReady();
 
 private:
+    static constexpr size_t MAX_WS_CLIENTS = 4;
+
     Controller& controller;
+    Metrics& metrics;
+    StateStore *stateStore;             // keeps the changes across a reboot, may be NULL
+    ControlProtocol control;
+    int wsClients[MAX_WS_CLIENTS];      // sockets of the WebSocket clients, -1 if unused
+    StripBuffer<uint8_t, ControlProtocol::MAX_MESSAGE_LENGTH> wsBuffer;  // received WebSocket message
+    AssetCache assets;
+    SegmentLayout segments;             // the last layout which was posted to the controller
     httpd_handle_t server = NULL;
+    TimerHandle_t stateTimer = NULL;    // checks for switches to the STREAM effect by the realtime receiver
 
     esp_err_t mount_storage();
+    bool add_ws_client(int sockfd);
+    void remove_ws_client(int sockfd);
+    esp_err_t send_ws(httpd_handle_t handle, int sockfd, const uint8_t *message, size_t length);
+    void broadcast_state(httpd_handle_t handle);
+
+    static void close_handler(httpd_handle_t handle, int sockfd);
+    static void state_timer_callback(TimerHandle_t timer);
+    static void sync_state(void *arg);
 
     static esp_err_t landing_page_handler(httpd_req_t *req);
     static esp_err_t status_handler(httpd_req_t *req);
     static esp_err_t color_handler(httpd_req_t *req);
+    static esp_err_t frame_handler(httpd_req_t *req);
+    static esp_err_t segments_handler(httpd_req_t *req);
+    static esp_err_t pixels_handler(httpd_req_t *req);
+    static esp_err_t ws_handler(httpd_req_t *req);
+    static esp_err_t metrics_handler(httpd_req_t *req);
 
     httpd_uri_t landing_page = {
         .uri = "/",
@@ -61,4 +74,42 @@ private:
         .handler = color_handler,
         .user_ctx = this
         };
+
+    httpd_uri_t frame = {
+        .uri = "/frame",
+        .method = HTTP_POST,
+        .handler = frame_handler,
+        .user_ctx = this
+        };
+
+    httpd_uri_t segments_uri = {
+        .uri = "/segments",
+        .method = HTTP_POST,
+        .handler = segments_handler,
+        .user_ctx = this
+        };
+
+    httpd_uri_t pixels = {
+        .uri = "/pixels",
+        .method = HTTP_POST,
+        .handler = pixels_handler,
+        .user_ctx = this
+        };
+
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = this
+        };
+
+    httpd_uri_t ws = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = this,
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        .is_websocket = true
+#endif
+        };
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "esp_log.h"
+#include "stateStore.hpp"
+
+const char *StateStore::TAG = "StateStore";
+
+static bool sameState(const ControlState &a, const ControlState &b)
+{
+    return a.effect == b.effect && a.effectSpeed == b.effectSpeed && a.color == b.color &&
+           a.brightness == b.brightness && a.transitionMs == b.transitionMs &&
+           a.rainbowSpeed == b.rainbowSpeed && a.rainbowSpread == b.rainbowSpread;
+}
+
+StateStore::StateStore(uint32_t saveDelayMs) :
+    saveDelayMs(saveDelayMs),
+    handle(0),
+    opened(false),
+    stored{},
+    hasStored(false),
+    changes(xQueueCreate(1, sizeof(ControlState))),
+    taskHandle(NULL),
+    writes(0)
+{
+    esp_err_t ret = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open the NVS namespace (%s)", esp_err_to_name(ret));
+        return;
+    }
+    opened = true;
+}
+
+StateStore::~StateStore()
+{
+    if (taskHandle)
+    {
+        vTaskDelete(taskHandle);
+    }
+    if (opened)
+    {
+        nvs_close(handle);
+    }
+    vQueueDelete(changes);
+}
+
+/**
+ * @brief Apply the stored state to the controller. Must be called before the
+ * controllerTask starts, the setters are called directly.
+ * @return false if there is no valid state
+ */
+bool StateStore::restore(Controller &controller)
+{
+    size_t length = sizeof(stored);
+    if (!opened || nvs_get_blob(handle, KEY, &stored, &length) != ESP_OK || length != sizeof(stored))
+    {
+        ESP_LOGI(TAG, "No stored state");
+        return false;
+    }
+    if (stored.effect >= EFFECT_COUNT || stored.effect == STREAM)
+    {
+        ESP_LOGW(TAG, "Invalid stored effect %d", stored.effect);
+        return false;
+    }
+    hasStored = true;
+
+    // the strip fades in from off with the stored transition
+    controller.setTransitionDuration(stored.transitionMs);
+    controller.setEffectSpeed(stored.effectSpeed);
+    controller.setRainbowSpeed(stored.rainbowSpeed);
+    controller.setRainbowSpread(stored.rainbowSpread);
+    controller.setTargetColor(stored.color);
+    controller.setTargetBrightness(stored.brightness);
+    controller.setEffect(stored.effect);
+    ESP_LOGI(TAG, "Restored effect %d, color %d %d %d, brightness %d", stored.effect,
+             stored.color.r, stored.color.g, stored.color.b, stored.brightness);
+    return true;
+}
+
+/**
+ * @brief Start the task which writes the changes.
+ */
+bool StateStore::start(UBaseType_t priority)
+{
+    if (!opened || !changes)
+    {
+        return false;
+    }
+    if (xTaskCreate(task, "stateStore", 2048, this, priority, &taskHandle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the store task");
+        taskHandle = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Note a changed state, never blocks. Only the latest state of a burst is written.
+ */
+void StateStore::update(const ControlState &state)
+{
+    if (changes)
+    {
+        xQueueOverwrite(changes, &state);
+    }
+}
+
+void StateStore::task(void *parameter)
+{
+    auto self = static_cast<StateStore *>(parameter);
+    while (1)
+    {
+        ControlState state;
+        xQueueReceive(self->changes, &state, portMAX_DELAY);
+
+        // every change within the delay restarts it
+        while (xQueueReceive(self->changes, &state, pdMS_TO_TICKS(self->saveDelayMs)) == pdTRUE)
+        {
+        }
+        self->write(state);
+    }
+}
+
+/**
+ * @brief Write the state to NVS unless it is already stored.
+ */
+void StateStore::write(const ControlState &state)
+{
+    ControlState next = state;
+    if (next.effect == STREAM)
+    {
+        // the uploaded frames are not stored, a reboot shows the effect before the stream
+        next.effect = hasStored ? stored.effect : SOLID;
+    }
+    if (hasStored && sameState(next, stored))
+    {
+        return;
+    }
+
+    esp_err_t ret = nvs_set_blob(handle, KEY, &next, sizeof(next));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(handle);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to write the state (%s)", esp_err_to_name(ret));
+        return;
+    }
+    stored = next;
+    hasStored = true;
+    writes++;
+    ESP_LOGD(TAG, "State written (%u writes)", writes);
+}
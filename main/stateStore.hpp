@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "controller.hpp"
+#include "controlProtocol.hpp"
+
+/**
+ * @brief Keeps the state of the controller in NVS, so the strip shows it again after a reboot.
+ *
+ * The HTTP server task passes every change with update(). The task of the store writes
+ * the state when it did not change for the save delay, so a dragged slider or a burst of
+ * commands results in one write. The STREAM effect is not stored, the effect before
+ * the stream is kept.
+ */
+class StateStore {
+public:
+    static const char *TAG;
+
+    StateStore(uint32_t saveDelayMs);
+    ~StateStore();
+
+    bool restore(Controller &controller);
+    bool start(UBaseType_t priority);
+    void update(const ControlState &state);
+
+    uint32_t getWrites() const { return writes; }
+
+private:
+    static constexpr const char *NAMESPACE = "neopixel";
+    static constexpr const char *KEY = "state1";     // the number changes with the layout of ControlState
+
+    const uint32_t saveDelayMs;
+    nvs_handle handle;
+    bool opened;
+    ControlState stored;        // the state in NVS
+    bool hasStored;
+    QueueHandle_t changes;      // the latest state, overwritten by update()
+    TaskHandle_t taskHandle;
+    uint32_t writes;
+
+    static void task(void *parameter);
+    void write(const ControlState &state);
+};
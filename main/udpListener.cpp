@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "udpListener.hpp"
+
+const char *UdpListener::TAG = "UdpListener";
+
+UdpListener::UdpListener(RealtimeReceiver &receiver, uint16_t ddpPort, uint16_t e131Port) :
+    receiver(receiver),
+    ddpPort(ddpPort),
+    e131Port(e131Port),
+    ddpSocket(-1),
+    e131Socket(-1),
+    running(false),
+    stopped(true),
+    taskHandle(NULL)
+{
+}
+
+UdpListener::~UdpListener()
+{
+    stop();
+}
+
+/**
+ * @brief Open the sockets and start the listener task.
+ * @return false if a socket could not be opened or the task not be created
+ */
+bool UdpListener::start(UBaseType_t priority)
+{
+    ddpSocket = openSocket(ddpPort);
+    e131Socket = openSocket(e131Port);
+    if (ddpSocket < 0 || e131Socket < 0)
+    {
+        stop();
+        return false;
+    }
+    joinUniverses();
+
+    running = true;
+    stopped = false;
+    if (xTaskCreate(task, "udpListener", 3072, this, priority, &taskHandle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the listener task");
+        running = false;
+        stopped = true;
+        stop();
+        return false;
+    }
+    ESP_LOGI(TAG, "Listening for DDP on port %d and E1.31 on port %d", ddpPort, e131Port);
+    return true;
+}
+
+/**
+ * @brief Stop the task and close the sockets. Blocks until the task ended (up to 100ms).
+ */
+void UdpListener::stop()
+{
+    running = false;
+    while (!stopped)
+    {
+        vTaskDelay(1);
+    }
+
+    if (ddpSocket >= 0)
+    {
+        close(ddpSocket);
+        ddpSocket = -1;
+    }
+    if (e131Socket >= 0)
+    {
+        close(e131Socket);
+        e131Socket = -1;
+    }
+}
+
+void UdpListener::task(void *parameter)
+{
+    auto self = static_cast<UdpListener *>(parameter);
+    while (self->running)
+    {
+        self->receive();
+    }
+    self->stopped = true;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Wait up to 100ms for a packet on one of the sockets and handle all available packets.
+ */
+void UdpListener::receive()
+{
+    fd_set sockets;
+    FD_ZERO(&sockets);
+    FD_SET(ddpSocket, &sockets);
+    FD_SET(e131Socket, &sockets);
+    struct timeval timeout = {0, 100000};
+
+    int ready = select((ddpSocket > e131Socket ? ddpSocket : e131Socket) + 1, &sockets, NULL, NULL, &timeout);
+    if (ready <= 0)
+    {
+        return;
+    }
+
+    if (FD_ISSET(ddpSocket, &sockets))
+    {
+        int length;
+        while ((length = recv(ddpSocket, packet, sizeof(packet), MSG_DONTWAIT)) > 0)
+        {
+            receiver.handleDdp(packet, length);
+        }
+    }
+    if (FD_ISSET(e131Socket, &sockets))
+    {
+        int length;
+        while ((length = recv(e131Socket, packet, sizeof(packet), MSG_DONTWAIT)) > 0)
+        {
+            receiver.handleE131(packet, length);
+        }
+    }
+}
+
+int UdpListener::openSocket(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Unable to create a socket for port %d: errno %d", port, errno);
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        ESP_LOGE(TAG, "Unable to bind port %d: errno %d", port, errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * @brief Join the multicast groups of the E1.31 universes. Unicast works without,
+ * so a failure is only logged.
+ */
+void UdpListener::joinUniverses()
+{
+    for (uint16_t i = 0; i < receiver.getUniverseCount(); i++)
+    {
+        uint16_t universe = receiver.getFirstUniverse() + i;
+        struct ip_mreq group;
+        memset(&group, 0, sizeof(group));
+        group.imr_multiaddr.s_addr = htonl(0xefff0000 | universe);
+        group.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(e131Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0)
+        {
+            ESP_LOGW(TAG, "Unable to join the multicast group of universe %d: errno %d", universe, errno);
+        }
+    }
+}
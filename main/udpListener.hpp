@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "realtimeReceiver.hpp"
+
+/**
+ * @brief Task which receives the DDP and E1.31 packets and passes them to the RealtimeReceiver.
+ * Both sockets are bound to all interfaces, the E1.31 socket also joins the
+ * multicast groups of the universes (239.255.<universe high>.<universe low>).
+ */
+class UdpListener {
+public:
+    static const char *TAG;
+    static constexpr size_t MAX_PACKET_LENGTH = 1472;   // UDP payload of an Ethernet frame
+
+    UdpListener(RealtimeReceiver &receiver,
+                uint16_t ddpPort = RealtimeReceiver::DDP_PORT,
+                uint16_t e131Port = RealtimeReceiver::E131_PORT);
+    ~UdpListener();
+
+    bool start(UBaseType_t priority);
+    void stop();
+    TaskHandle_t getTask() const { return taskHandle; }
+
+private:
+    RealtimeReceiver &receiver;
+    const uint16_t ddpPort;
+    const uint16_t e131Port;
+    int ddpSocket;
+    int e131Socket;
+    volatile bool running;
+    volatile bool stopped;
+    TaskHandle_t taskHandle;
+    uint8_t packet[MAX_PACKET_LENGTH];
+
+    static void task(void *parameter);
+    void receive();
+    int openSocket(uint16_t port);
+    void joinUniverses();
+};
@@ -0,0 +1,85 @@
+# Prints the static RAM (.data and .bss) of the firmware per subsystem.
+# Run after the link: cmake -DNM=<nm of the toolchain> -DELF=<firmware elf> -P ramBudget.cmake
+#
+# With CONFIG_ESP_WS2812_STATIC_ALLOCATION the long-lived objects of app_main and their
+# buffers are in .bss (the storage of create<T>() in main.cpp), so the budget covers the
+# frame buffers. Task stacks, queues and the chunks of the animation player are allocated
+# from the heap at boot, the firmware logs the free heap after its init.
+cmake_minimum_required(VERSION 3.15)
+
+if(NOT NM OR NOT ELF)
+    message(FATAL_ERROR "usage: cmake -DNM=<nm> -DELF=<elf> -P ramBudget.cmake")
+endif()
+
+# label:symbols of the subsystem (regular expression on the class or symbol name)
+set(SUBSYSTEMS
+    "strip:WS2812|BitBangOutput|ColorLut|ws2812"
+    "controller:Controller|Crossfade|FrameScheduler"
+    "http server:Server|JsonArena|AssetCache|ControlProtocol|RequestParser|cJSON|httpd"
+    "realtime:RealtimeReceiver|UdpListener"
+    "metrics:Metrics"
+    "state store:StateStore"
+    "animation:AnimationPlayer")
+set(OTHER "other (SDK, WiFi, lwIP)")
+
+execute_process(COMMAND ${NM} --print-size --size-sort --demangle ${ELF}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(WARNING "RAM budget: ${NM} failed on ${ELF}")
+    return()
+endif()
+
+# the demangled names may contain list separators and brackets
+string(REPLACE ";" "," symbols "${symbols}")
+string(REPLACE "[" "(" symbols "${symbols}")
+string(REPLACE "]" ")" symbols "${symbols}")
+string(REPLACE "\n" ";" lines "${symbols}")
+
+set(labels "")
+foreach(subsystem ${SUBSYSTEMS} ${OTHER})
+    string(REGEX REPLACE ":.*" "" label "${subsystem}")
+    list(APPEND labels "${label}")
+    set(bytes_${label} 0)
+endforeach()
+set(total 0)
+
+foreach(line ${lines})
+    if(NOT line MATCHES "^[0-9a-fA-F]+ ([0-9a-fA-F]+) [bBdD] (.*)$")
+        continue()
+    endif()
+    math(EXPR size "0x${CMAKE_MATCH_1}")
+    set(name "${CMAKE_MATCH_2}")
+    # the storage of create<T>() belongs to T
+    if(name MATCHES "create<([A-Za-z0-9_]+)")
+        set(name "${CMAKE_MATCH_1}")
+    endif()
+
+    set(owner "${OTHER}")
+    foreach(subsystem ${SUBSYSTEMS})
+        string(REGEX MATCH "^([^:]*):(.*)$" unused "${subsystem}")
+        set(label "${CMAKE_MATCH_1}")
+        if(name MATCHES "${CMAKE_MATCH_2}")
+            set(owner "${label}")
+            break()
+        endif()
+    endforeach()
+    math(EXPR bytes_${owner} "${bytes_${owner}} + ${size}")
+    math(EXPR total "${total} + ${size}")
+endforeach()
+
+function(print_row label bytes)
+    string(LENGTH "${label}" length)
+    math(EXPR padding "28 - ${length}")
+    string(REPEAT " " ${padding} spaces)
+    string(LENGTH "${bytes}" length)
+    math(EXPR padding "8 - ${length}")
+    string(REPEAT " " ${padding} indent)
+    message(STATUS "  ${label}${spaces}${indent}${bytes}")
+endfunction()
+
+message(STATUS "RAM budget of ${ELF} (.data + .bss bytes):")
+foreach(label ${labels})
+    print_row("${label}" ${bytes_${label}})
+endforeach()
+print_row("total" ${total})